@@ -0,0 +1,26 @@
+@echo off
+
+rem assembles the workloads in bench\ and runs yvm-bench on them, then
+rem generates synthetic sources with ygen and runs yasm-bench on them.
+rem the samples are compared with yperf against the last commit in
+rem bench\results.txt and recorded when nothing regressed, the script
+rem fails on a regression. extra arguments go to both benchmarks
+rem (--runs, --warmup)
+
+call make.bat
+
+if %ERRORLEVEL% == 0 (
+	if exist bench\run.samples del bench\run.samples
+	for %%f in (bench\*.yasm) do yasm.exe -o bench\%%~nf.bin %%f
+	yvm-bench.exe %* --samples bench\run.samples bench\arith.bin bench\fib.bin bench\stack.bin bench\print.bin
+)
+
+if %ERRORLEVEL% == 0 (
+	if not exist bench\gen mkdir bench\gen
+	for %%s in (straight labels forward comments mixed) do ygen.exe --shape %%s --stmts 200000 -o bench\gen\%%s.yasm
+	yasm-bench.exe %* --samples bench\run.samples bench\gen\straight.yasm bench\gen\labels.yasm bench\gen\forward.yasm bench\gen\comments.yasm bench\gen\mixed.yasm
+)
+
+if %ERRORLEVEL% == 0 (
+	yperf.exe compare bench\results.txt bench\run.samples --record
+)
@@ -0,0 +1,279 @@
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+// yperf: keeps benchmark samples from yvm-bench and yasm-bench
+// (--samples) in a results file keyed by git commit and compares a new
+// run against a stored baseline. a benchmark regresses when its median
+// is slower by more than the threshold and the 95% confidence
+// intervals of the two medians do not overlap, so noisy runs are not
+// reported. compare exits with 1 when anything regressed.
+//
+// results file: one line per sample, `commit tool workload metric ns`
+// samples file: the same without the commit
+
+void usage(std::ostream& stream) {
+	stream << "Incorrect usage. Correct usage is..." << std::endl;
+	stream << "yperf record <results> <samples> [--commit <id>]" << std::endl;
+	stream << "yperf compare <results> <samples> [flags]" << std::endl;
+	stream << "    --baseline <id>      commit to compare against (default: the last recorded one)" << std::endl;
+	stream << "    --threshold <pct>    allowed slowdown of the median (default 5)" << std::endl;
+	stream << "    --record             record the samples when nothing regressed" << std::endl;
+	stream << "    --commit <id>        commit of the samples (default: git describe --always --dirty)" << std::endl;
+	stream << "yperf list <results>" << std::endl;
+}
+
+// tool, workload, metric
+using BenchKey = std::tuple<std::string, std::string, std::string>;
+using Samples = std::map<BenchKey, std::vector<uint64_t>>;
+
+struct Results {
+	std::vector<std::string> commits; // in recording order
+	std::map<std::string, Samples> samples;
+};
+
+std::string key_name(const BenchKey& key) {
+	return std::get<0>(key) + " " + std::get<1>(key) + " " + std::get<2>(key);
+}
+
+std::optional<Results> read_results(const std::string& path) {
+	Results results;
+	std::ifstream in(path);
+	if(!in.is_open()) {
+		return results; // nothing recorded yet
+	}
+	std::string line;
+	int line_no = 0;
+	while(std::getline(in, line)) {
+		++line_no;
+		if(line.empty() || line[0] == '#') {
+			continue;
+		}
+		std::istringstream fields(line);
+		std::string commit;
+		BenchKey key;
+		uint64_t ns;
+		if(!(fields >> commit >> std::get<0>(key) >> std::get<1>(key) >> std::get<2>(key) >> ns)) {
+			std::cerr << path << " " << line_no << ": ERROR: malformed result" << std::endl;
+			return std::nullopt;
+		}
+		if(results.samples.find(commit) == results.samples.end()) {
+			results.commits.push_back(commit);
+		}
+		results.samples[commit][key].push_back(ns);
+	}
+	return results;
+}
+
+std::optional<Samples> read_samples(const std::string& path) {
+	std::ifstream in(path);
+	if(!in.is_open()) {
+		std::cerr << "ERROR: cannot read `" << path << "`" << std::endl;
+		return std::nullopt;
+	}
+	Samples samples;
+	std::string line;
+	int line_no = 0;
+	while(std::getline(in, line)) {
+		++line_no;
+		if(line.empty()) {
+			continue;
+		}
+		std::istringstream fields(line);
+		BenchKey key;
+		uint64_t ns;
+		if(!(fields >> std::get<0>(key) >> std::get<1>(key) >> std::get<2>(key) >> ns)) {
+			std::cerr << path << " " << line_no << ": ERROR: malformed sample" << std::endl;
+			return std::nullopt;
+		}
+		samples[key].push_back(ns);
+	}
+	if(samples.empty()) {
+		std::cerr << "ERROR: no samples in `" << path << "`" << std::endl;
+		return std::nullopt;
+	}
+	return samples;
+}
+
+bool append_results(const std::string& path, const std::string& commit, const Samples& samples) {
+	std::ofstream out(path, std::ios::app);
+	for(const auto& [key, values] : samples) {
+		for(uint64_t ns : values) {
+			out << commit << " " << key_name(key) << " " << ns << "\n";
+		}
+	}
+	return out.good();
+}
+
+std::string current_commit() {
+	FILE* git = popen("git describe --always --dirty", "r");
+	if(git == nullptr) {
+		return "unknown";
+	}
+	char buf[128] = { 0 };
+	std::string commit = fgets(buf, sizeof(buf), git) != nullptr ? buf : "";
+	pclose(git);
+	while(!commit.empty() && std::isspace(static_cast<unsigned char>(commit.back()))) {
+		commit.pop_back();
+	}
+	return commit.empty() ? "unknown" : commit;
+}
+
+// median with a distribution free 95% confidence interval, the
+// interval is between two order statistics of the sorted samples
+struct Estimate {
+	double median;
+	double low;
+	double high;
+};
+
+Estimate estimate(std::vector<uint64_t> values) {
+	std::sort(values.begin(), values.end());
+	const size_t n = values.size();
+	const double half = 1.96 * std::sqrt(static_cast<double>(n)) / 2.0;
+	const double mid = static_cast<double>(n) / 2.0;
+	size_t lo = static_cast<size_t>(std::max(0.0, std::floor(mid - half)));
+	size_t hi = static_cast<size_t>(std::min(static_cast<double>(n - 1), std::ceil(mid + half)));
+	double median = n % 2 == 1 ? static_cast<double>(values[n / 2])
+		: (static_cast<double>(values[n / 2 - 1]) + static_cast<double>(values[n / 2])) / 2.0;
+	return { median, static_cast<double>(values[lo]), static_cast<double>(values[hi]) };
+}
+
+// returns the number of regressions
+int compare(const Samples& base, const Samples& run, double threshold) {
+	int regressions = 0;
+	for(const auto& [key, values] : run) {
+		auto it = base.find(key);
+		if(it == base.end()) {
+			printf("%-32s new\n", key_name(key).c_str());
+			continue;
+		}
+		Estimate b = estimate(it->second);
+		Estimate r = estimate(values);
+		double change = b.median > 0 ? (r.median - b.median) * 100.0 / b.median : 0.0;
+		const char* verdict = "ok";
+		if(change > threshold && r.low > b.high) {
+			verdict = "REGRESSED";
+			++regressions;
+		}
+		else if(change < -threshold && r.high < b.low) {
+			verdict = "improved";
+		}
+		else if(std::fabs(change) > threshold) {
+			verdict = "noise";
+		}
+		printf("%-32s %12.3f ms [%.3f, %.3f]  -> %12.3f ms [%.3f, %.3f]  %+7.2f%%  %s\n", key_name(key).c_str(),
+			b.median / 1e6, b.low / 1e6, b.high / 1e6, r.median / 1e6, r.low / 1e6, r.high / 1e6, change, verdict);
+	}
+	return regressions;
+}
+
+int main(int argc, char* argv[])
+{
+	if(argc < 3) {
+		usage(std::cerr);
+		return EXIT_FAILURE;
+	}
+	const std::string command = argv[1];
+	const std::string results_path = argv[2];
+	std::optional<std::string> commit;
+	std::optional<std::string> baseline;
+	double threshold = 5.0;
+	bool record = command == "record";
+	int first_flag = command == "list" ? 3 : 4;
+	for(int i = first_flag;i < argc;++i) {
+		if(strcmp(argv[i], "--commit") == 0 && i + 1 < argc) {
+			commit = argv[++i];
+		}
+		else if(strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+			baseline = argv[++i];
+		}
+		else if(strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+			threshold = atof(argv[++i]);
+		}
+		else if(strcmp(argv[i], "--record") == 0) {
+			record = true;
+		}
+		else {
+			usage(std::cerr);
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::optional<Results> results = read_results(results_path);
+	if(!results.has_value()) {
+		return EXIT_FAILURE;
+	}
+	if(command == "list") {
+		for(const std::string& c : results->commits) {
+			size_t count = 0;
+			for(const auto& [key, values] : results->samples[c]) {
+				count += values.size();
+			}
+			printf("%-24s %4zu benchmarks %6zu samples\n", c.c_str(), results->samples[c].size(), count);
+		}
+		return EXIT_SUCCESS;
+	}
+	if((command != "record" && command != "compare") || argc < 4) {
+		usage(std::cerr);
+		return EXIT_FAILURE;
+	}
+	std::optional<Samples> run = read_samples(argv[3]);
+	if(!run.has_value()) {
+		return EXIT_FAILURE;
+	}
+	if(!commit.has_value()) {
+		commit = current_commit();
+	}
+
+	int regressions = 0;
+	if(command == "compare") {
+		if(!baseline.has_value()) {
+			for(auto it = results->commits.rbegin();it != results->commits.rend();++it) {
+				if(*it != commit.value()) {
+					baseline = *it;
+					break;
+				}
+			}
+		}
+		if(!baseline.has_value()) {
+			printf("no baseline recorded, nothing to compare\n");
+		}
+		else if(results->samples.find(baseline.value()) == results->samples.end()) {
+			std::cerr << "ERROR: no results for baseline `" << baseline.value() << "`" << std::endl;
+			return EXIT_FAILURE;
+		}
+		else {
+			printf("%s -> %s (threshold %.1f%%)\n", baseline->c_str(), commit->c_str(), threshold);
+			regressions = compare(results->samples[baseline.value()], run.value(), threshold);
+			if(regressions > 0) {
+				printf("%d regression%s\n", regressions, regressions == 1 ? "" : "s");
+			}
+		}
+	}
+
+	if(record && regressions == 0) {
+		if(!append_results(results_path, commit.value(), run.value())) {
+			std::cerr << "ERROR: cannot write `" << results_path << "`" << std::endl;
+			return EXIT_FAILURE;
+		}
+		printf("recorded %s\n", commit->c_str());
+	}
+	return regressions > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
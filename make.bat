@@ -3,7 +3,39 @@
 echo Compiling yvm...
 gcc ./yvm/main.c -o yvm.exe -m32
 
+if %ERRORLEVEL% == 0 (
+	echo Compiling ytrace...
+	gcc ./yvm/ytrace.c -o ytrace.exe -m32
+)
+
+if %ERRORLEVEL% == 0 (
+	echo Compiling yvm-bench...
+	gcc ./yvm/bench.c -o yvm-bench.exe -m32
+)
+
+if %ERRORLEVEL% == 0 (
+	echo Compiling yvm2c...
+	gcc ./yvm/yvm2c.c -o yvm2c.exe -m32
+)
+
 if %ERRORLEVEL% == 0 (
 	echo Compiling yasm...
-	g++ -fmax-errors=2 -Wdouble-promotion -Wdiv-by-zero -Wold-style-cast -Wextra -pedantic -Wall -Werror -Wswitch -std=c++2a ./yasm/main.cpp -o yasm.exe
+	gcc -c ./yvm/embed.c -o yvm_embed.o
+	g++ -fmax-errors=2 -Wdouble-promotion -Wdiv-by-zero -Wold-style-cast -Wextra -pedantic -Wall -Werror -Wswitch -std=c++2a ./yasm/main.cpp yvm_embed.o -o yasm.exe
+)
+
+if %ERRORLEVEL% == 0 (
+	echo Compiling ylink...
+	g++ -fmax-errors=2 -Wdouble-promotion -Wdiv-by-zero -Wold-style-cast -Wextra -pedantic -Wall -Werror -Wswitch -std=c++2a ./yasm/ylink.cpp -o ylink.exe
+)
+
+if %ERRORLEVEL% == 0 (
+	echo Compiling ygen and yasm-bench...
+	g++ -fmax-errors=2 -Wdouble-promotion -Wdiv-by-zero -Wold-style-cast -Wextra -pedantic -Wall -Werror -Wswitch -std=c++2a ./yasm/ygen.cpp -o ygen.exe
+	g++ -fmax-errors=2 -Wdouble-promotion -Wdiv-by-zero -Wold-style-cast -Wextra -pedantic -Wall -Werror -Wswitch -std=c++2a ./yasm/bench.cpp -o yasm-bench.exe
+)
+
+if %ERRORLEVEL% == 0 (
+	echo Compiling yperf...
+	g++ -fmax-errors=2 -Wdouble-promotion -Wdiv-by-zero -Wold-style-cast -Wextra -pedantic -Wall -Werror -Wswitch -std=c++2a ./bench/yperf.cpp -o yperf.exe
 )
\ No newline at end of file
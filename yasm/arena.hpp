@@ -1,15 +1,26 @@
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
 #include <memory>
+#include <new>
+#include <type_traits>
 #include <utility>
 
+// Bump allocator over a chain of blocks. A new block is linked in when the
+// current one is exhausted, so the arena starts small and grows with the
+// input. reset() rewinds to the first block and keeps the others for reuse.
 class ArenaAllocator {
 public:
-    explicit ArenaAllocator(const size_t max_num_bytes)
-        : m_size { max_num_bytes }
-        , m_buffer { new std::byte[max_num_bytes] }
-        , m_offset { m_buffer }
+    struct Stats {
+        size_t used; // bytes handed out since the last reset
+        size_t reserved; // bytes held in blocks
+        size_t high_water_mark; // largest `used` ever seen
+        size_t blocks;
+    };
+
+    explicit ArenaAllocator(const size_t block_size = 64 * 1024)
+        : m_block_size { block_size }
     {
     }
 
@@ -17,33 +28,42 @@ public:
     ArenaAllocator& operator=(const ArenaAllocator&) = delete;
 
     ArenaAllocator(ArenaAllocator&& other) noexcept
-        : m_size { std::exchange(other.m_size, 0) }
-        , m_buffer { std::exchange(other.m_buffer, nullptr) }
+        : m_block_size { other.m_block_size }
+        , m_first { std::exchange(other.m_first, nullptr) }
+        , m_current { std::exchange(other.m_current, nullptr) }
         , m_offset { std::exchange(other.m_offset, nullptr) }
+        , m_end { std::exchange(other.m_end, nullptr) }
+        , m_destructors { std::exchange(other.m_destructors, nullptr) }
+        , m_stats { std::exchange(other.m_stats, Stats {}) }
     {
     }
 
     ArenaAllocator& operator=(ArenaAllocator&& other) noexcept
     {
-        std::swap(m_size, other.m_size);
-        std::swap(m_buffer, other.m_buffer);
+        std::swap(m_block_size, other.m_block_size);
+        std::swap(m_first, other.m_first);
+        std::swap(m_current, other.m_current);
         std::swap(m_offset, other.m_offset);
+        std::swap(m_end, other.m_end);
+        std::swap(m_destructors, other.m_destructors);
+        std::swap(m_stats, other.m_stats);
         return *this;
     }
 
     template <typename T>
     [[nodiscard]] T* alloc()
     {
-        size_t remaining_num_bytes = m_size - static_cast<size_t>(m_offset - m_buffer);
-        auto pointer = static_cast<void*>(m_offset);
-        const auto aligned_address = std::align(alignof(T), sizeof(T), pointer, remaining_num_bytes);
-        if (aligned_address == nullptr) {
-            throw std::bad_alloc {};
-        }
-        m_offset = static_cast<std::byte*>(aligned_address) + sizeof(T);
-        return static_cast<T*>(aligned_address);
+        return static_cast<T*>(alloc_bytes(sizeof(T), alignof(T)));
+    }
+
+    template <typename T>
+    [[nodiscard]] T* alloc_array(const size_t count)
+    {
+        return static_cast<T*>(alloc_bytes(sizeof(T) * count, alignof(T)));
     }
 
+    // No destructor is run for objects created this way, use it for
+    // trivially destructible nodes.
     template <typename T, typename... Args>
     [[nodiscard]] T* emplace(Args&&... args)
     {
@@ -51,18 +71,131 @@ public:
         return new (allocated_memory) T { std::forward<Args>(args)... };
     }
 
+    // Like emplace, but the destructor runs on reset() or when the arena
+    // is destroyed. Costs one extra record per object.
+    template <typename T, typename... Args>
+    [[nodiscard]] T* emplace_owned(Args&&... args)
+    {
+        T* object = emplace<T>(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            auto record = emplace<Destructor>();
+            record->object = object;
+            record->destroy = [](void* p) { static_cast<T*>(p)->~T(); };
+            record->next = m_destructors;
+            m_destructors = record;
+        }
+        return object;
+    }
+
+    void reset()
+    {
+        run_destructors();
+        m_current = m_first;
+        m_offset = m_first != nullptr ? m_first->data() : nullptr;
+        m_end = m_first != nullptr ? m_first->data() + m_first->size : nullptr;
+        m_stats.used = 0;
+    }
+
+    [[nodiscard]] Stats stats() const
+    {
+        return m_stats;
+    }
+
     ~ArenaAllocator()
     {
-        // No destructors are called for the stored objects. Thus, memory
-        // leaks are possible (e.g. when storing std::vector objects or
-        // other non-trivially destructable objects in the allocator).
-        // Although this could be changed, it would come with additional
-        // runtime overhead and therefore is not implemented.
-        delete[] m_buffer;
+        run_destructors();
+        while (m_first != nullptr) {
+            Block* next = m_first->next;
+            ::operator delete(m_first);
+            m_first = next;
+        }
     }
 
 private:
-    size_t m_size;
-    std::byte* m_buffer;
-    std::byte* m_offset;
-};
\ No newline at end of file
+    struct Block {
+        Block* next;
+        size_t size;
+
+        std::byte* data()
+        {
+            return reinterpret_cast<std::byte*>(this + 1);
+        }
+    };
+
+    struct Destructor {
+        void* object;
+        void (*destroy)(void*);
+        Destructor* next;
+    };
+
+    void* alloc_bytes(const size_t size, const size_t align)
+    {
+        void* aligned = try_fit(size, align);
+        if (aligned == nullptr) {
+            next_block(size + align);
+            aligned = try_fit(size, align);
+            if (aligned == nullptr) {
+                throw std::bad_alloc {};
+            }
+        }
+        return aligned;
+    }
+
+    void* try_fit(const size_t size, const size_t align)
+    {
+        if (m_offset == nullptr) {
+            return nullptr;
+        }
+        size_t remaining_num_bytes = static_cast<size_t>(m_end - m_offset);
+        void* pointer = m_offset;
+        if (std::align(align, size, pointer, remaining_num_bytes) == nullptr) {
+            return nullptr;
+        }
+        std::byte* next_offset = static_cast<std::byte*>(pointer) + size;
+        m_stats.used += static_cast<size_t>(next_offset - m_offset);
+        m_stats.high_water_mark = std::max(m_stats.high_water_mark, m_stats.used);
+        m_offset = next_offset;
+        return pointer;
+    }
+
+    // moves to the next retained block if it is large enough, otherwise
+    // links a fresh block after the current one
+    void next_block(const size_t min_size)
+    {
+        if (m_current != nullptr && m_current->next != nullptr && m_current->next->size >= min_size) {
+            m_current = m_current->next;
+        } else {
+            const size_t size = std::max(m_block_size, min_size);
+            Block* block = static_cast<Block*>(::operator new(sizeof(Block) + size));
+            block->size = size;
+            if (m_current == nullptr) {
+                block->next = nullptr;
+                m_first = block;
+            } else {
+                block->next = m_current->next;
+                m_current->next = block;
+            }
+            m_current = block;
+            m_stats.reserved += size;
+            m_stats.blocks += 1;
+        }
+        m_offset = m_current->data();
+        m_end = m_current->data() + m_current->size;
+    }
+
+    void run_destructors()
+    {
+        while (m_destructors != nullptr) {
+            m_destructors->destroy(m_destructors->object);
+            m_destructors = m_destructors->next;
+        }
+    }
+
+    size_t m_block_size;
+    Block* m_first = nullptr;
+    Block* m_current = nullptr;
+    std::byte* m_offset = nullptr;
+    std::byte* m_end = nullptr;
+    Destructor* m_destructors = nullptr;
+    Stats m_stats {};
+};
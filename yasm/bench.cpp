@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "generation.hpp"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#else
+#include <windows.h>
+#include <psapi.h>
+#endif
+
+// yasm-bench: times the lexer, the parser and the generator separately
+// on sources from ygen (or any single file program, includes are not
+// followed) and reports MB/s lexed, statements/s parsed and peak
+// memory, as a table on stderr and JSON on stdout or in a file.
+
+struct PhaseTimes {
+	uint64_t lex_ns;
+	uint64_t parse_ns;
+	uint64_t gen_ns;
+};
+
+struct BenchResult {
+	std::string name;
+	size_t bytes = 0;
+	size_t tokens = 0;
+	size_t stmts = 0;
+	size_t image_bytes = 0;
+	PhaseTimes median {};
+	PhaseTimes min {};
+	ArenaAllocator::Stats strings {};
+};
+
+void usage(std::ostream& stream) {
+	stream << "Incorrect usage. Correct usage is..." << std::endl;
+	stream << "yasm-bench [flags] <input.yasm>..." << std::endl;
+	stream << "    --runs <n>       measured runs per input (default 10)" << std::endl;
+	stream << "    --warmup <n>     unmeasured runs first (default 2)" << std::endl;
+	stream << "    --json <file>    write the JSON report to a file instead of stdout" << std::endl;
+	stream << "    --samples <file> append every measured run to a file for yperf" << std::endl;
+}
+
+// the high-water mark of the whole process, it never goes down so it
+// is reported once for the run rather than per input
+long peak_rss_kb() {
+#ifndef _WIN32
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+#else
+	PROCESS_MEMORY_COUNTERS counters;
+	K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+	return static_cast<long>(counters.PeakWorkingSetSize / 1024);
+#endif
+}
+
+uint64_t now_ns() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// one assembly of `src`, the copy of the source is not timed
+PhaseTimes run_once(const std::string& src, const std::string& path, BenchResult& r) {
+	std::string copy = src;
+	PhaseTimes t {};
+	uint64_t start = now_ns();
+	std::vector<Token> tokens = Lexer(std::move(copy)).lex(path);
+	uint64_t lexed = now_ns();
+	r.tokens = tokens.size();
+	std::optional<NodeProg> prog = Parser(std::move(tokens)).parse_prog();
+	uint64_t parsed = now_ns();
+	if(!prog.has_value()) {
+		std::cerr << "ERROR: `" << path << "` is not a valid program" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	r.stmts = prog->size();
+	r.strings = prog->strings.memory();
+	Generator generator(std::move(prog.value()));
+	generator.gen_prog();
+	r.image_bytes = generator.image().size();
+	uint64_t end = now_ns();
+	t.lex_ns = lexed - start;
+	t.parse_ns = parsed - lexed;
+	t.gen_ns = end - parsed;
+	return t;
+}
+
+uint64_t median_of(std::vector<uint64_t>& samples) {
+	std::sort(samples.begin(), samples.end());
+	return samples[samples.size() / 2];
+}
+
+double per_second(double count, uint64_t ns) {
+	return ns > 0 ? count * 1e9 / static_cast<double>(ns) : 0.0;
+}
+
+std::string input_name(const std::string& path) {
+	return std::filesystem::path(path).stem().string();
+}
+
+// one line per measured run: tool input metric ns
+void write_sample(FILE* out, const std::string& name, const char* metric, uint64_t ns) {
+	fprintf(out, "yasm %s %s %llu\n", name.c_str(), metric, static_cast<unsigned long long>(ns));
+}
+
+void write_json(FILE* out, const std::vector<BenchResult>& results, int runs, int warmup, long rss_kb) {
+	fprintf(out, "{\n");
+	fprintf(out, "  \"runs\": %d,\n", runs);
+	fprintf(out, "  \"warmup\": %d,\n", warmup);
+	fprintf(out, "  \"peak_rss_kb\": %ld,\n", rss_kb);
+	fprintf(out, "  \"inputs\": [\n");
+	for(size_t i = 0;i < results.size();++i) {
+		const BenchResult& r = results[i];
+		fprintf(out, "    {\n");
+		fprintf(out, "      \"name\": \"%s\",\n", r.name.c_str());
+		fprintf(out, "      \"bytes\": %zu,\n", r.bytes);
+		fprintf(out, "      \"tokens\": %zu,\n", r.tokens);
+		fprintf(out, "      \"statements\": %zu,\n", r.stmts);
+		fprintf(out, "      \"image_bytes\": %zu,\n", r.image_bytes);
+		fprintf(out, "      \"lex_ns\": %llu,\n", static_cast<unsigned long long>(r.median.lex_ns));
+		fprintf(out, "      \"parse_ns\": %llu,\n", static_cast<unsigned long long>(r.median.parse_ns));
+		fprintf(out, "      \"gen_ns\": %llu,\n", static_cast<unsigned long long>(r.median.gen_ns));
+		fprintf(out, "      \"min_lex_ns\": %llu,\n", static_cast<unsigned long long>(r.min.lex_ns));
+		fprintf(out, "      \"min_parse_ns\": %llu,\n", static_cast<unsigned long long>(r.min.parse_ns));
+		fprintf(out, "      \"min_gen_ns\": %llu,\n", static_cast<unsigned long long>(r.min.gen_ns));
+		fprintf(out, "      \"lex_mb_per_second\": %.2f,\n", per_second(static_cast<double>(r.bytes) / 1e6, r.median.lex_ns));
+		fprintf(out, "      \"statements_per_second\": %.0f,\n", per_second(static_cast<double>(r.stmts), r.median.parse_ns));
+		fprintf(out, "      \"gen_statements_per_second\": %.0f,\n", per_second(static_cast<double>(r.stmts), r.median.gen_ns));
+		fprintf(out, "      \"string_arena_bytes\": %zu\n", r.strings.reserved);
+		fprintf(out, "    }%s\n", i + 1 < results.size() ? "," : "");
+	}
+	fprintf(out, "  ]\n");
+	fprintf(out, "}\n");
+}
+
+int main(int argc, char* argv[])
+{
+	int runs = 10;
+	int warmup = 2;
+	const char* json_path = nullptr;
+	const char* samples_path = nullptr;
+	std::vector<std::string> paths;
+	for(int i = 1;i < argc;++i) {
+		if(strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+			runs = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+			warmup = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+			json_path = argv[++i];
+		}
+		else if(strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+			samples_path = argv[++i];
+		}
+		else {
+			paths.push_back(argv[i]);
+		}
+	}
+	if(paths.empty() || runs < 1 || warmup < 0) {
+		usage(std::cerr);
+		return EXIT_FAILURE;
+	}
+
+	FILE* samples_file = nullptr;
+	if(samples_path != nullptr && (samples_file = fopen(samples_path, "a")) == nullptr) {
+		std::cerr << "ERROR: cannot write `" << samples_path << "`" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::vector<BenchResult> results;
+	for(const std::string& path : paths) {
+		std::optional<std::string> src = read_source(path);
+		if(!src.has_value()) {
+			std::cerr << "ERROR: cannot read `" << path << "`" << std::endl;
+			return EXIT_FAILURE;
+		}
+		BenchResult r;
+		r.name = input_name(path);
+		r.bytes = src->size();
+		for(int i = 0;i < warmup;++i) {
+			run_once(src.value(), path, r);
+		}
+		std::vector<uint64_t> lex;
+		std::vector<uint64_t> parse;
+		std::vector<uint64_t> gen;
+		for(int i = 0;i < runs;++i) {
+			PhaseTimes t = run_once(src.value(), path, r);
+			lex.push_back(t.lex_ns);
+			parse.push_back(t.parse_ns);
+			gen.push_back(t.gen_ns);
+			if(samples_file != nullptr) {
+				write_sample(samples_file, r.name, "lex", t.lex_ns);
+				write_sample(samples_file, r.name, "parse", t.parse_ns);
+				write_sample(samples_file, r.name, "gen", t.gen_ns);
+			}
+		}
+		r.median = { median_of(lex), median_of(parse), median_of(gen) };
+		r.min = { lex.front(), parse.front(), gen.front() };
+
+		fprintf(stderr, "%-12s %9zu bytes %8zu stmts  lex %8.3f ms %7.1f MB/s  parse %8.3f ms %6.2f Mstmt/s  gen %8.3f ms\n",
+			r.name.c_str(), r.bytes, r.stmts,
+			static_cast<double>(r.median.lex_ns) / 1e6, per_second(static_cast<double>(r.bytes) / 1e6, r.median.lex_ns),
+			static_cast<double>(r.median.parse_ns) / 1e6, per_second(static_cast<double>(r.stmts) / 1e6, r.median.parse_ns),
+			static_cast<double>(r.median.gen_ns) / 1e6);
+		results.push_back(std::move(r));
+	}
+
+	if(samples_file != nullptr) {
+		fclose(samples_file);
+	}
+
+	long rss_kb = peak_rss_kb();
+	fprintf(stderr, "peak rss %ld KB over all inputs\n", rss_kb);
+
+	FILE* out = stdout;
+	if(json_path != nullptr) {
+		out = fopen(json_path, "w");
+		if(out == nullptr) {
+			std::cerr << "ERROR: cannot write `" << json_path << "`" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	write_json(out, results, runs, warmup, rss_kb);
+	if(out != stdout) {
+		fclose(out);
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "lexer.hpp"
+#include "object.hpp"
+
+// bump whenever the generated output for the same source changes
+#define YASM_CACHE_VERSION 3
+
+// cache entry layout:
+//   "YC" u32 dep_count, deps: (str path relative to input, u64 hash)
+//   u32 payload_size, payload (the exact bytes of the output file)
+
+uint64_t fnv1a(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL) {
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for(size_t i = 0;i < size;++i) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+uint64_t fnv1a(const std::string& str, uint64_t hash = 0xcbf29ce484222325ULL) {
+	return fnv1a(str.data(), str.size(), hash);
+}
+
+class AssemblyCache {
+public:
+	explicit AssemblyCache(std::string dir)
+		: m_dir(std::move(dir))
+	{
+	}
+
+	// `mode` distinguishes outputs that differ for the same source (bin/obj)
+	std::string key(const std::string& source, const std::string& mode) const
+	{
+		uint64_t hash = fnv1a(&m_version, sizeof(m_version));
+		hash = fnv1a(mode, hash);
+		hash = fnv1a(source, hash);
+		char buffer[17];
+		snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(hash));
+		return buffer;
+	}
+
+	// returns the cached output if the entry exists and every file it
+	// was built from is unchanged
+	std::optional<std::string> restore(const std::string& key, const std::string& input) const
+	{
+		FILE* file = fopen(entry_path(key).c_str(), "rb");
+		if(file == NULL) {
+			return std::nullopt;
+		}
+		std::filesystem::path base = std::filesystem::path(input).parent_path();
+		char magic[2];
+		uint32_t dep_count;
+		bool ok = fread(magic, sizeof(char), 2, file) == 2 && magic[0] == 'Y' && magic[1] == 'C'
+			&& __obj_read_u32(file, &dep_count);
+		for(uint32_t i = 0;ok && i < dep_count;++i) {
+			std::string dep;
+			uint64_t hash;
+			ok = __obj_read_str(file, &dep) && fread(&hash, sizeof(uint64_t), 1, file) == 1;
+			if(ok) {
+				std::optional<std::string> contents = read_source((base / dep).string());
+				ok = contents.has_value() && fnv1a(contents.value()) == hash;
+			}
+		}
+		std::string payload;
+		ok = ok && __obj_read_str(file, &payload);
+		fclose(file);
+		if(!ok) {
+			return std::nullopt;
+		}
+		return payload;
+	}
+
+	// `deps` are the canonical paths collected by lex_file
+	void store(const std::string& key, const std::string& input, const std::vector<std::string>& deps, const std::string& payload) const
+	{
+		std::filesystem::path base = std::filesystem::weakly_canonical(std::filesystem::path(input)).parent_path();
+		std::string entry("YC", 2);
+		__obj_put_u32(entry, static_cast<uint32_t>(deps.size()));
+		for(const std::string& dep : deps) {
+			std::optional<std::string> contents = read_source(dep);
+			uint64_t hash = contents.has_value() ? fnv1a(contents.value()) : 0;
+			__obj_put_str(entry, std::filesystem::path(dep).lexically_relative(base).string());
+			entry.append(reinterpret_cast<const char*>(&hash), sizeof(uint64_t));
+		}
+		__obj_put_str(entry, payload);
+		std::error_code ec;
+		std::filesystem::create_directories(m_dir, ec);
+		// write to a private file first so concurrent builds never
+		// observe a half written entry
+		std::string tmp_path = entry_path(key) + ".tmp" + std::to_string(std::random_device{}());
+		if(!write_file(tmp_path, entry)) {
+			return;
+		}
+		std::filesystem::rename(tmp_path, entry_path(key), ec);
+		if(ec) {
+			std::filesystem::remove(tmp_path, ec);
+		}
+	}
+
+private:
+	std::string entry_path(const std::string& key) const
+	{
+		return (std::filesystem::path(m_dir) / (key + ".ycache")).string();
+	}
+
+	const std::string m_dir;
+	const int m_version = YASM_CACHE_VERSION;
+};
@@ -2,329 +2,291 @@
 
 #include <algorithm>
 #include <cstdio>
+#include <cstring>
 #include <cassert>
 #include <string>
+#include <vector>
 
+#include "instr.hpp"
+#include "object.hpp"
 #include "parser.hpp"
 
-void consume_un(...) {
-
-}
-
-#define REG_V0 0
-#define REG_V1 1
-
-int __reg_to_no(std::string reg) {
-	if(reg == "v0") {
-		return REG_V0;
-	}
-	if(reg == "v1") {
-		return REG_V1;
-	}
-	assert(false && "unkown register");
-}
-
-typedef enum {
-	INSTR_PUSH = 0,
-	INSTR_POP = 1,
-	INSTR_SYSCALL = 2,
-	INSTR_MOV_V0 = 3,
-	INSTR_MOV_V1 = 4,
-	INSTR_JMP = 5,
-	INSTR_ADD = 6,
-	INSTR_SUB = 7,
-	INSTR_MUL = 8,
-	INSTR_DIV = 9,
-	INSTR_RPUSH = 10,
-	INSTR_PUSH_IP = 11,
-	INSTR_PUSH_BP = 12,
-	INSTR_PUSH_SP = 13,
-	INSTR_JMP_ONSTACK = 14,
-} InstrType;
-
-typedef struct Instr {
-	InstrType type;
-	int operand;
-} Instr;
-
 typedef struct Yvm_Out_file {
 	size_t m_count = 0ULL;
-	Instr m_code[65000];
-	
+	std::vector<Instr> m_code;
+
 	friend Yvm_Out_file& operator<<(Yvm_Out_file& outf, Instr in) {
-		outf.m_code[outf.m_count] = in;
+		outf.m_code.push_back(in);
 		outf.m_count += 1ULL;
 		return outf;
 	}
 
-	void write(std::string path) {
-		FILE* file = fopen(path.c_str(), "wb");
-
-		fwrite("YM", sizeof(char), 2, file);
-		fwrite("\0\0\0\0\0\0", sizeof(char), 6, file);
-		fwrite(reinterpret_cast<char*>(m_code), sizeof(Instr), m_count, file);
-		
-		fclose(file);
+	bool write(std::string path) {
+		return write_bytecode(path, m_code.data(), m_count);
 	}
 } Yvm_Out_file;
 
 class Generator {
 public:
-	struct Label {
-		size_t addr;
-		std::string name;
-	};
-
 	struct UnresolvedSymbol {
-		Instr* in;
-		std::string symbol;
-		Token def;
+		size_t index; // instruction to patch, or the offset of a data word
+		size_t stmt; // statement referencing the symbol
+		bool in_data = false;
 	};
 
-	std::optional<Label> label_lookup(std::string name) {
-		for(int i = 0;i < static_cast<int>(m_labels.size());++i) {
-			if(m_labels[i].name == name) {
-				return m_labels[i];
-			}
+	std::optional<size_t> label_lookup(int symbol) {
+		if(m_labels[symbol] < 0) {
+			return std::nullopt;
 		}
-		return std::nullopt;
+		return static_cast<size_t>(m_labels[symbol]);
 	}
 
-	explicit Generator(NodeProg prog)
+	// with `debug` set the image carries a debug section (yasm -g)
+	explicit Generator(NodeProg prog, bool debug = false)
 		: m_prog(std::move(prog))
+		, m_labels(m_prog.strings.size(), -1)
+		, m_data_labels(m_prog.strings.size(), false)
+		, m_debug(debug)
 	{
+		m_output.m_code.reserve(m_prog.size());
 	}
 
-	void GeneratorError(Token tok, std::string msg) {
-		putloc(tok);
+	void GeneratorError(size_t stmt, std::string msg) {
+		putloc(m_prog, m_prog.locs[stmt]);
 		std::cout << " ERROR: " << msg << "\n";
 		exit(EXIT_FAILURE);
 	}
 
-	Instr m_compile_int(NodeExprIntLit* expr) {
-		return { .type = INSTR_PUSH, .operand = std::stoi(expr->int_lit.value.value()) };
+	void emit(InstrType type, int operand = 0) {
+		m_output << Instr { .type = type, .operand = operand };
 	}
 
-	Instr m_compile_ident(NodeExprIdent* ident) {
-		std::optional<Label> label = label_lookup(ident->ident.value.value());
-		if(!label.has_value()) {
-			Instr in = { .type = INSTR_JMP, .operand = 0 };
-			m_unresolved_symbols.push_back({ .in = &m_output.m_code[m_output.m_count - 1] , .symbol = ident->ident.value.value(), .def = ident->ident });
-			m_has_entry = true;
-			return in;
-		}
-		m_has_entry = true;
-		Instr in = { .type = INSTR_JMP, .operand = static_cast<int>(label.value().addr) };
-		return in;
+	// emits an instruction whose operand is the address of the symbol
+	// named by statement `stmt`, patched once all labels are known
+	void emit_ref(InstrType type, size_t stmt) {
+		m_unresolved_symbols.push_back({ .index = m_output.m_count, .stmt = stmt });
+		emit(type);
 	}
 
-	Instr gen_expr(const NodeExpr* expr)
-	{
-		if(std::holds_alternative<NodeExprIntLit*>(expr->var)) {
-			return m_compile_int(std::get<NodeExprIntLit*>(expr->var));
-		}
-		if(std::holds_alternative<NodeExprIdent*>(expr->var)) {
-			return m_compile_ident(std::get<NodeExprIdent*>(expr->var));
-		}
-		assert(false && "unreacheable");
+	static bool is_data(StmtKind kind) {
+		return kind == StmtKind::word || kind == StmtKind::word_label || kind == StmtKind::byte
+			|| kind == StmtKind::ascii || kind == StmtKind::zero;
 	}
 
-	void gen_stmt(const NodeStmt* stmt)
-	{
-		struct StmtVisitor {
-			Generator& gen;
-
-			void operator()(const NodeStmtPush* stmt_push) const
-			{
-				if(std::holds_alternative<NodeExprIntLit*>(stmt_push->expr->var)) {
-					gen.m_output << gen.gen_expr(stmt_push->expr);
-				}
-				if(std::holds_alternative<NodeExprReg*>(stmt_push->expr->var)) {
-					NodeExprReg* reg_p = std::get<NodeExprReg*>(stmt_push->expr->var);
-					int REG = __reg_to_no(reg_p->name);
-					Instr in = { .type = INSTR_RPUSH, .operand = REG };
-					gen.m_output << in;
-				}
-				if(std::holds_alternative<NodeExprIdent*>(stmt_push->expr->var)) {
-					gen.m_output << gen.gen_expr(stmt_push->expr);
-				}
-			}
-
-			void operator()(const NodeStmtPop* stmt_pop) const
-			{
-				int REG = __reg_to_no(stmt_pop->reg);
-				Instr in = { .type = INSTR_POP, .operand = REG };
-				gen.m_output << in;
-			}
-
-			void operator()(const NodeStmtMov* stmt_mov) const
-			{
-				NodeExpr* to = stmt_mov->to;
-				NodeExpr* expr = stmt_mov->expr;
-				if(!std::holds_alternative<NodeExprReg*>(to->var)) {
-					gen.GeneratorError(stmt_mov->def, "except register at left");
-				}
-				if(!std::holds_alternative<NodeExprIntLit*>(expr->var)) {
-					gen.GeneratorError(stmt_mov->def, "except int literal at right");
-				}
-				NodeExprIntLit* lit = std::get<NodeExprIntLit*>(expr->var);
-				int REG = __reg_to_no(std::get<NodeExprReg*>(to->var)->name);
-				Instr in;
-				if(REG == REG_V0) {
-					in = { .type = INSTR_MOV_V0 , .operand = std::stoi(lit->int_lit.value.value()) };
-				}
-				else if(REG == REG_V1) {
-					in = { .type = INSTR_MOV_V1 , .operand = std::stoi(lit->int_lit.value.value()) };
-				}
-				else {
-					assert(false && "unreacheable");
-				}
-				gen.m_output << in;
+	// a label names data when the next statement that emits anything is
+	// a data directive, otherwise it names the next instruction
+	bool names_data(size_t stmt) const {
+		for(size_t i = stmt + 1;i < m_prog.size();++i) {
+			if(m_prog.kinds[i] != StmtKind::label && m_prog.kinds[i] != StmtKind::global) {
+				return is_data(m_prog.kinds[i]);
 			}
+		}
+		return false;
+	}
 
-			void operator()(const NodeStmtSyscall* stmt_syscall) const
-			{
-				consume_un(stmt_syscall);
-				Instr in = { .type = INSTR_SYSCALL, .operand = 0 };
-				gen.m_output << in;
-			}
+	// grows the data section by `size` zero bytes, returns their offset
+	size_t alloc_data(size_t stmt, size_t size) {
+		const size_t offset = m_data.size();
+		if(size > YBC_DATA_END - YBC_DATA_BASE - offset) {
+			GeneratorError(stmt, "data section is larger than " + std::to_string(YBC_DATA_END - YBC_DATA_BASE) + " bytes");
+		}
+		m_data.resize(offset + size);
+		return offset;
+	}
 
-			void operator()(const NodeStmtIpush* stmt_ipush) const
-			{
-				consume_un(stmt_ipush);
-				Instr in = { .type = INSTR_PUSH_IP, .operand = 0 };
-				gen.m_output << in;
-			}
+	// patches the reference `us` with the address of its symbol
+	void resolve(const UnresolvedSymbol& us, int addr) {
+		if(us.in_data) {
+			memcpy(m_data.data() + us.index, &addr, sizeof(int));
+			return;
+		}
+		if(m_data_labels[m_prog.operands[us.stmt]] && m_prog.kinds[us.stmt] != StmtKind::push_label) {
+			GeneratorError(us.stmt, "`" + std::string(m_prog.str(us.stmt)) + "` names data, not code");
+		}
+		m_output.m_code[us.index].operand = addr;
+	}
 
-			void operator()(const NodeStmtSpush* stmt_spush) const
-			{
-				consume_un(stmt_spush);
-				Instr in = { .type = INSTR_PUSH_SP, .operand = 0 };
-				gen.m_output << in;
+	void gen_stmts()
+	{
+		const size_t count = m_prog.size();
+		const StmtKind* kinds = m_prog.kinds.data();
+		const int* operands = m_prog.operands.data();
+		for(size_t i = 0;i < count;++i) {
+			const int operand = operands[i];
+			if(m_debug) {
+				record_debug(i);
 			}
-
-			void operator()(const NodeStmtCall* stmt_call) const
-			{
-				Yvm_Out_file& out = gen.m_output;
-				if(!stmt_call->expr.has_value()) {
-					gen.GeneratorError(stmt_call->def, "call from stack not supported"); // TODO: add support for with
+			switch(kinds[i]) {
+			case StmtKind::push_int:   emit(INSTR_PUSH, operand);  break;
+			case StmtKind::push_reg:   emit(INSTR_RPUSH, operand); break;
+			case StmtKind::push_label: emit_ref(INSTR_PUSH, i);    break;
+			case StmtKind::pop:        emit(INSTR_POP, operand);   break;
+			case StmtKind::mov_v0:     emit(INSTR_MOV_V0, operand); break;
+			case StmtKind::mov_v1:     emit(INSTR_MOV_V1, operand); break;
+			case StmtKind::syscall:    emit(INSTR_SYSCALL);        break;
+			case StmtKind::add:        emit(INSTR_ADD);            break;
+			case StmtKind::sub:        emit(INSTR_SUB);            break;
+			case StmtKind::mul:        emit(INSTR_MUL);            break;
+			case StmtKind::div:        emit(INSTR_DIV);            break;
+			case StmtKind::ipush:      emit(INSTR_PUSH_IP);        break;
+			case StmtKind::bpush:      emit(INSTR_PUSH_BP);        break;
+			case StmtKind::spush:      emit(INSTR_PUSH_SP);        break;
+			case StmtKind::sjmp:       emit(INSTR_JMP_ONSTACK);    break;
+			case StmtKind::load:       emit(INSTR_LOAD);           break;
+			case StmtKind::store:      emit(INSTR_STORE);          break;
+			case StmtKind::memcpy:     emit(INSTR_MEMCPY);         break;
+			case StmtKind::memset:     emit(INSTR_MEMSET);         break;
+			case StmtKind::memcmp:     emit(INSTR_MEMCMP);         break;
+			case StmtKind::vadd:       emit(INSTR_VADD);           break;
+			case StmtKind::vmul:       emit(INSTR_VMUL);           break;
+			case StmtKind::vsum:       emit(INSTR_VSUM);           break;
+			case StmtKind::jmp:        emit_ref(INSTR_JMP, i);     break;
+			case StmtKind::jtab:       emit(INSTR_JTAB, operand);  break;
+			// the table is jmp words, linked like any other jump
+			case StmtKind::jtab_target: emit_ref(INSTR_JMP, i);    break;
+			case StmtKind::call:
+				// return address is the instruction after the jump
+				emit(INSTR_PUSH_IP);
+				emit(INSTR_PUSH, 3);
+				emit(INSTR_ADD);
+				emit_ref(INSTR_JMP, i);
+				break;
+			case StmtKind::entry:
+				m_has_entry = true;
+				emit_ref(INSTR_JMP, i);
+				break;
+			case StmtKind::label:
+				if(m_labels[operand] < 0) {
+					m_data_labels[operand] = names_data(i);
+					m_labels[operand] = m_data_labels[operand] ? YBC_DATA_BASE + static_cast<int>(m_data.size()) : static_cast<int>(m_output.m_count);
 				}
-				Instr ipush = { .type = INSTR_PUSH_IP, .operand = 0 };
-				out << ipush;
-				Instr push_num = { .type = INSTR_PUSH, .operand = 3 };
-				out << push_num;
-				Instr add = { .type = INSTR_ADD, .operand = 0 };
-				out << add;
-				out << gen.gen_expr(stmt_call->expr.value());
-				Instr sjmp = { .type = INSTR_JMP_ONSTACK, .operand = 0 };
-				out << sjmp;
-			}
-
-			void operator()(const NodeStmtBpush* stmt_bpush) const
-			{
-				consume_un(stmt_bpush);
-				Instr in = { .type = INSTR_PUSH_BP, .operand = 0 };
-				gen.m_output << in;
-			}
-
-			void operator()(const NodeStmtSjmp* stmt_sjmp) const
-			{
-				consume_un(stmt_sjmp);
-				Instr in = { .type = INSTR_JMP_ONSTACK, .operand = 0 };
-				gen.m_output << in;
-			}
-
-			void operator()(const NodeStmtAdd* stmt_add) const
-			{
-				consume_un(stmt_add);
-				Instr in = { .type = INSTR_ADD, .operand = 0 };
-				gen.m_output << in;
-			}
-
-			void operator()(const NodeStmtSub* stmt_sub) const
-			{
-				consume_un(stmt_sub);
-				Instr in = { .type = INSTR_SUB, .operand = 0 };
-				gen.m_output << in;
+				break;
+			case StmtKind::word: {
+				const size_t at = alloc_data(i, sizeof(int));
+				memcpy(m_data.data() + at, &operand, sizeof(int));
+				break;
 			}
-
-			void operator()(const NodeStmtMul* stmt_mul) const
-			{
-				consume_un(stmt_mul);
-				Instr in = { .type = INSTR_MUL, .operand = 0 };
-				gen.m_output << in;
+			case StmtKind::word_label:
+				m_unresolved_symbols.push_back({ .index = alloc_data(i, sizeof(int)), .stmt = i, .in_data = true });
+				break;
+			case StmtKind::byte:
+				m_data[alloc_data(i, 1)] = static_cast<uint8_t>(operand);
+				break;
+			case StmtKind::ascii: {
+				std::string_view text = m_prog.str(i);
+				const size_t at = alloc_data(i, text.size());
+				memcpy(m_data.data() + at, text.data(), text.size());
+				break;
 			}
-
-			void operator()(const NodeStmtDiv* stmt_div) const
-			{
-				consume_un(stmt_div);
-				Instr in = { .type = INSTR_DIV, .operand = 0 };
-				gen.m_output << in;
-			}
-
-			void operator()(const NodeStmtLabel* stmt_label) const
-			{
-				gen.m_labels.push_back({ .addr = gen.m_output.m_count , .name = stmt_label->name });
+			case StmtKind::zero:
+				alloc_data(i, static_cast<size_t>(operand));
+				break;
+			case StmtKind::global:
+				m_globals.push_back(i);
+				break;
 			}
+		}
+	}
 
-			void operator()(const NodeStmtJmp* stmt_jmp) const
-			{
-				std::optional<Label> label = gen.label_lookup(stmt_jmp->label);
-				if(!label.has_value()) {
-					Instr in = { .type = INSTR_JMP, .operand = 0 };
-					gen.m_output << in;
-					gen.m_unresolved_symbols.push_back({ .in = &gen.m_output.m_code[gen.m_output.m_count - 1] , .symbol = stmt_jmp->label, .def = stmt_jmp->def });
-					return;
-				}
-				Instr in = { .type = INSTR_JMP, .operand = static_cast<int>(label.value().addr) };
-				gen.m_output << in;
-			}
+	uint32_t debug_string(uint32_t id)
+	{
+		if(m_debug_strings.size() < m_prog.strings.size()) {
+			m_debug_strings.resize(m_prog.strings.size(), -1);
+		}
+		if(m_debug_strings[id] < 0) {
+			m_debug_strings[id] = static_cast<int>(m_debug_info.strings.size());
+			m_debug_info.strings.emplace_back(m_prog.strings.get(id));
+		}
+		return static_cast<uint32_t>(m_debug_strings[id]);
+	}
 
-			void operator()(const NodeStmtEntry* stmt_entry) const
-			{
-				std::optional<Label> label = gen.label_lookup(stmt_entry->name);
-				if(!label.has_value()) {
-					Instr in = { .type = INSTR_JMP, .operand = 0 };
-					gen.m_output << in;
-					gen.m_unresolved_symbols.push_back({ .in = &gen.m_output.m_code[gen.m_output.m_count - 1] , .symbol = stmt_entry->name, .def = stmt_entry->def });
-					gen.m_has_entry = true;
-					return;
-				}
-				gen.m_has_entry = true;
-				Instr in = { .type = INSTR_JMP, .operand = static_cast<int>(label.value().addr) };
-				gen.m_output << in;
+	void record_debug(size_t stmt)
+	{
+		const uint32_t addr = static_cast<uint32_t>(m_output.m_count);
+		const StmtKind kind = m_prog.kinds[stmt];
+		if(kind == StmtKind::label) {
+			if(names_data(stmt)) {
+				return;
 			}
-		};
-
-		StmtVisitor visitor { .gen = *this };
-		std::visit(visitor, stmt->var);
+			m_debug_info.labels.push_back({ .addr = addr, .name = debug_string(static_cast<uint32_t>(m_prog.operands[stmt])) });
+			return;
+		}
+		if(kind == StmtKind::global || is_data(kind)) {
+			return;
+		}
+		const SourceLoc& loc = m_prog.locs[stmt];
+		m_debug_info.lines.push_back({ .addr = addr, .file = debug_string(loc.file), .line = static_cast<uint32_t>(loc.line), .col = static_cast<uint32_t>(loc.col) });
+		if(kind == StmtKind::call) {
+			// ipush, push 3, add, then the jump
+			m_debug_info.calls.push_back({ .addr = addr + 3, .name = debug_string(static_cast<uint32_t>(m_prog.operands[stmt])) });
+		}
 	}
 
+	// generates a complete program, every symbol must be defined
 	void gen_prog()
 	{
-		for(const NodeStmt* stmt : m_prog.stmts) {
-			gen_stmt(stmt);
-		}
+		gen_stmts();
 		if(!m_has_entry) {
 			std::cerr << "entry not provided!\n";
 			exit(1);
 		}
-		for(int i = 0;i < static_cast<int>(m_unresolved_symbols.size());++i) {
-			UnresolvedSymbol us = m_unresolved_symbols[i];
-			std::optional<Label> label = label_lookup(us.symbol);
-			if(label.has_value()) {
-				us.in->operand = static_cast<int>(label.value().addr);
+		for(const UnresolvedSymbol& us : m_unresolved_symbols) {
+			std::optional<size_t> addr = label_lookup(m_prog.operands[us.stmt]);
+			if(addr.has_value()) {
+				resolve(us, static_cast<int>(addr.value()));
+				continue;
+			}
+			GeneratorError(us.stmt, "undefined symbol `" + std::string(m_prog.str(us.stmt)) + "`");
+		}
+	}
+
+	// generates a relocatable object, symbols not defined here are left
+	// for ylink to resolve against the globals of other objects
+	ObjectFile gen_object()
+	{
+		gen_stmts();
+		ObjectFile obj;
+		obj.has_entry = m_has_entry;
+		for(size_t stmt : m_globals) {
+			std::optional<size_t> addr = label_lookup(m_prog.operands[stmt]);
+			if(!addr.has_value()) {
+				GeneratorError(stmt, "global symbol `" + std::string(m_prog.str(stmt)) + "` is not defined");
+			}
+			obj.symbols.push_back({ .addr = static_cast<uint32_t>(addr.value()), .in_data = m_data_labels[m_prog.operands[stmt]],
+				.name = std::string(m_prog.str(stmt)) });
+		}
+		for(const UnresolvedSymbol& us : m_unresolved_symbols) {
+			std::optional<size_t> addr = label_lookup(m_prog.operands[us.stmt]);
+			if(addr.has_value()) {
+				resolve(us, static_cast<int>(addr.value()));
+				RelocKind kind = m_data_labels[m_prog.operands[us.stmt]] ? RelocKind::local_data : RelocKind::local;
+				obj.relocs.push_back({ .index = static_cast<uint32_t>(us.index), .kind = kind, .in_data = us.in_data, .symbol = "" });
 				continue;
 			}
-			GeneratorError(us.def, "undefined symbol `" + us.symbol + "`");
+			obj.relocs.push_back({ .index = static_cast<uint32_t>(us.index), .kind = RelocKind::symbol, .in_data = us.in_data,
+				.symbol = std::string(m_prog.str(us.stmt)) });
 		}
-		m_output.write("out.bin");
+		obj.code.assign(m_output.m_code.begin(), m_output.m_code.end());
+		obj.data = m_data;
+		return obj;
+	}
+
+	// contents of the bytecode file for the generated program
+	std::string image() const
+	{
+		return serialize_bytecode(m_output.m_code.data(), m_output.m_count, m_debug ? &m_debug_info : nullptr, m_data);
 	}
 
 private:
 	const NodeProg m_prog;
 	bool m_has_entry = false;
-	std::vector<Label> m_labels;
+	std::vector<int> m_labels; // address by string id, -1 if undefined
+	std::vector<bool> m_data_labels; // by string id, the label names data
+	std::vector<uint8_t> m_data; // the data section, at YBC_DATA_BASE
 	std::vector<UnresolvedSymbol> m_unresolved_symbols;
+	std::vector<size_t> m_globals;
+	bool m_debug;
+	DebugInfo m_debug_info;
+	std::vector<int> m_debug_strings; // debug string id by string id, -1 if unused
 	Yvm_Out_file m_output;
-};
\ No newline at end of file
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#define REG_V0 0
+#define REG_V1 1
+
+typedef enum {
+	INSTR_PUSH = 0,
+	INSTR_POP = 1,
+	INSTR_SYSCALL = 2,
+	INSTR_MOV_V0 = 3,
+	INSTR_MOV_V1 = 4,
+	INSTR_JMP = 5,
+	INSTR_ADD = 6,
+	INSTR_SUB = 7,
+	INSTR_MUL = 8,
+	INSTR_DIV = 9,
+	INSTR_RPUSH = 10,
+	INSTR_PUSH_IP = 11,
+	INSTR_PUSH_BP = 12,
+	INSTR_PUSH_SP = 13,
+	INSTR_JMP_ONSTACK = 14,
+	// 15 is the breakpoint trap of ydb
+	INSTR_LOAD = 16,
+	INSTR_STORE = 17,
+	INSTR_MEMCPY = 18,
+	INSTR_MEMSET = 19,
+	INSTR_MEMCMP = 20,
+	INSTR_VADD = 21,
+	INSTR_VMUL = 22,
+	INSTR_VSUM = 23,
+	INSTR_JTAB = 24,
+} InstrType;
+
+typedef struct Instr {
+	InstrType type;
+	int operand;
+} Instr;
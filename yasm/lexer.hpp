@@ -1,5 +1,12 @@
 #pragma once
 
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <optional>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
 #include <string>
 #include <vector>
 #include <cstdio>
@@ -25,6 +32,23 @@ enum class TokenType {
     spush,
     sjmp,
     call,
+    global,
+    include,
+    string_lit,
+    sysdef,
+    load,
+    store,
+    memcpy,
+    memset,
+    memcmp,
+    vadd,
+    vmul,
+    vsum,
+    jtab,
+    word,
+    byte,
+    ascii,
+    zero,
 };
 
 std::string tok_to_string(const TokenType type)
@@ -70,6 +94,40 @@ std::string tok_to_string(const TokenType type)
         return "`sjmp`";
     case TokenType::call:
         return "`call`";
+    case TokenType::global:
+        return "`global`";
+    case TokenType::include:
+        return "`include`";
+    case TokenType::string_lit:
+        return "`string literal`";
+    case TokenType::sysdef:
+        return "`sysdef`";
+    case TokenType::load:
+        return "`load`";
+    case TokenType::store:
+        return "`store`";
+    case TokenType::memcpy:
+        return "`memcpy`";
+    case TokenType::memset:
+        return "`memset`";
+    case TokenType::memcmp:
+        return "`memcmp`";
+    case TokenType::vadd:
+        return "`vadd`";
+    case TokenType::vmul:
+        return "`vmul`";
+    case TokenType::vsum:
+        return "`vsum`";
+    case TokenType::jtab:
+        return "`jtab`";
+    case TokenType::word:
+        return "`.word`";
+    case TokenType::byte:
+        return "`.byte`";
+    case TokenType::ascii:
+        return "`.ascii`";
+    case TokenType::zero:
+        return "`.zero`";
     }
     assert(false);
 }
@@ -191,6 +249,54 @@ public:
                     tokens.push_back({ .type = TokenType::call, .line =  line_count, .col =  m_col - static_cast<int>(buf.size()), .file = file });
                     buf.clear();
                 }
+                else if(buf == "global") {
+                    tokens.push_back({ .type = TokenType::global, .line =  line_count, .col =  m_col - static_cast<int>(buf.size()), .file = file });
+                    buf.clear();
+                }
+                else if(buf == "load") {
+                    tokens.push_back({ .type = TokenType::load, .line =  line_count, .col =  m_col - static_cast<int>(buf.size()), .file = file });
+                    buf.clear();
+                }
+                else if(buf == "store") {
+                    tokens.push_back({ .type = TokenType::store, .line =  line_count, .col =  m_col - static_cast<int>(buf.size()), .file = file });
+                    buf.clear();
+                }
+                else if(buf == "memcpy") {
+                    tokens.push_back({ .type = TokenType::memcpy, .line =  line_count, .col =  m_col - static_cast<int>(buf.size()), .file = file });
+                    buf.clear();
+                }
+                else if(buf == "memset") {
+                    tokens.push_back({ .type = TokenType::memset, .line =  line_count, .col =  m_col - static_cast<int>(buf.size()), .file = file });
+                    buf.clear();
+                }
+                else if(buf == "memcmp") {
+                    tokens.push_back({ .type = TokenType::memcmp, .line =  line_count, .col =  m_col - static_cast<int>(buf.size()), .file = file });
+                    buf.clear();
+                }
+                else if(buf == "vadd") {
+                    tokens.push_back({ .type = TokenType::vadd, .line =  line_count, .col =  m_col - static_cast<int>(buf.size()), .file = file });
+                    buf.clear();
+                }
+                else if(buf == "vmul") {
+                    tokens.push_back({ .type = TokenType::vmul, .line =  line_count, .col =  m_col - static_cast<int>(buf.size()), .file = file });
+                    buf.clear();
+                }
+                else if(buf == "vsum") {
+                    tokens.push_back({ .type = TokenType::vsum, .line =  line_count, .col =  m_col - static_cast<int>(buf.size()), .file = file });
+                    buf.clear();
+                }
+                else if(buf == "jtab") {
+                    tokens.push_back({ .type = TokenType::jtab, .line =  line_count, .col =  m_col - static_cast<int>(buf.size()), .file = file });
+                    buf.clear();
+                }
+                else if(buf == "sysdef") {
+                    tokens.push_back({ .type = TokenType::sysdef, .line =  line_count, .col =  m_col - static_cast<int>(buf.size()), .file = file });
+                    buf.clear();
+                }
+                else if(buf == "include") {
+                    tokens.push_back({ .type = TokenType::include, .line =  line_count, .col =  m_col - static_cast<int>(buf.size()), .file = file });
+                    buf.clear();
+                }
                 else if(buf == "v0" || buf == "v1") {
                     tokens.push_back({ .type = TokenType::reg, .line =  line_count, .col =  m_col - static_cast<int>(buf.size()), .value = buf, .file = file });
                     buf.clear();
@@ -215,6 +321,32 @@ public:
                     consume();
                 }
             }
+            else if (peek().value() == '.' && peek(1).has_value() && std::isalpha(peek(1).value())) {
+                // data directives
+                buf.push_back(consume());
+                while(peek().has_value() && std::isalpha(peek().value())) {
+                    buf.push_back(consume());
+                }
+                TokenType type;
+                if(buf == ".word") {
+                    type = TokenType::word;
+                }
+                else if(buf == ".byte") {
+                    type = TokenType::byte;
+                }
+                else if(buf == ".ascii") {
+                    type = TokenType::ascii;
+                }
+                else if(buf == ".zero") {
+                    type = TokenType::zero;
+                }
+                else {
+                    std::cerr << file << " " << line_count << ":" << m_col - static_cast<int>(buf.size()) << " ERROR: unknown directive `" << buf << "`" << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                tokens.push_back({ .type = type, .line = line_count, .col = m_col - static_cast<int>(buf.size()), .file = file });
+                buf.clear();
+            }
             else if (peek().value() == ',') {
                 consume();
                 tokens.push_back({ .type = TokenType::comma, .line = line_count, .col = m_col - 1, .file = file });
@@ -241,6 +373,16 @@ public:
                 tokens.push_back({ .type = TokenType::int_lit, .line = line_count , .col = m_col - static_cast<int>(buf.size()), .value = std::to_string(static_cast<int>(buf[0])), .file = file });
                 buf.clear();
             }
+            else if(peek().value() == '"') {
+                consume();
+                buf.clear();
+                while(peek().has_value() && peek().value() != '"' && peek().value() != '\n') {
+                    buf.push_back(consume());
+                }
+                consume();
+                tokens.push_back({ .type = TokenType::string_lit, .line = line_count , .col = m_col - static_cast<int>(buf.size()) - 2, .value = buf, .file = file });
+                buf.clear();
+            }
             else if (peek().value() == '\n') {
                 consume();
                 m_col = 1;
@@ -276,4 +418,57 @@ private:
     const std::string m_src;
     size_t m_index = 0;
     int m_col = 1;
-};
\ No newline at end of file
+};
+
+std::optional<std::string> read_source(const std::string& path)
+{
+    std::fstream input(path, std::ios::in);
+    if(!input.is_open()) {
+        return std::nullopt;
+    }
+    std::stringstream contents_stream;
+    contents_stream << input.rdbuf();
+    return contents_stream.str();
+}
+
+// lexes `path` and splices the tokens of every `include "file"` in place.
+// include paths are relative to the including file, each file is
+// included at most once.
+std::vector<Token> lex_file(const std::string& path, std::vector<std::string>& included)
+{
+    std::optional<std::string> contents = read_source(path);
+    if(!contents.has_value()) {
+        std::cerr << "ERROR: cannot open file `" << path << "`" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    included.push_back(std::filesystem::weakly_canonical(path).string());
+    Lexer lexer(std::move(contents.value()));
+    std::vector<Token> tokens = lexer.lex(path);
+    std::vector<Token> result;
+    result.reserve(tokens.size());
+    for(size_t i = 0;i < tokens.size();++i) {
+        if(tokens[i].type != TokenType::include) {
+            result.push_back(std::move(tokens[i]));
+            continue;
+        }
+        if(i + 1 >= tokens.size() || tokens[i + 1].type != TokenType::string_lit) {
+            putloc(tokens[i]);
+            std::cout << " ERROR: excepted " << tok_to_string(TokenType::string_lit) << " after `include`\n";
+            exit(EXIT_FAILURE);
+        }
+        const Token& name = tokens[++i];
+        std::filesystem::path inc_path = std::filesystem::path(path).parent_path() / name.value.value();
+        std::string key = std::filesystem::weakly_canonical(inc_path).string();
+        if(std::find(included.begin(), included.end(), key) != included.end()) {
+            continue;
+        }
+        if(!std::filesystem::exists(inc_path)) {
+            putloc(name);
+            std::cout << " ERROR: included file `" << inc_path.string() << "` not found\n";
+            exit(EXIT_FAILURE);
+        }
+        std::vector<Token> inc_tokens = lex_file(inc_path.string(), included);
+        result.insert(result.end(), std::make_move_iterator(inc_tokens.begin()), std::make_move_iterator(inc_tokens.end()));
+    }
+    return result;
+}
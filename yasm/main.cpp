@@ -7,17 +7,32 @@
 #include <cstring>
 
 #include "generation.hpp"
+#include "cache.hpp"
+#include "../yvm/embed.h"
 
 void usage(std::ostream& stream) {
 	stream << "Incorrect usage. Correct usage is..." << std::endl;
 	stream << "yasm <flags> <input.yasm>" << std::endl;
+	stream << "flags:" << std::endl;
+	stream << "    -r    run the program after assembling" << std::endl;
+	stream << "    -d    run the program with debugger" << std::endl;
+	stream << "    -o <path>    write the output to <path> (default: out.bin unless running)" << std::endl;
+	stream << "    -c    assemble into object file <input>.yo for ylink" << std::endl;
+	stream << "    -g    emit a debug section (source lines, labels, call sites)" << std::endl;
+	stream << "    --cache <dir>    reuse outputs of unchanged inputs (default: $YASM_CACHE)" << std::endl;
 }
 
 enum class Flags {
 	run,
 	debug,
+	object,
+	debug_info,
 };
 
+bool takes_value(const char* option) {
+	return strcmp(option, "--cache") == 0 || strcmp(option, "-o") == 0;
+}
+
 std::vector<Flags> collect_flags(int argc, char* argv[]) {
 	std::vector<Flags> flags;
 	for(int i = 1;i < argc && argv[i][0] == '-';++i) {
@@ -27,14 +42,57 @@ std::vector<Flags> collect_flags(int argc, char* argv[]) {
 		else if(strcmp(argv[i], "-d") == 0) {
 			flags.push_back(Flags::debug);
 		}
+		else if(strcmp(argv[i], "-c") == 0) {
+			flags.push_back(Flags::object);
+		}
+		else if(strcmp(argv[i], "-g") == 0) {
+			flags.push_back(Flags::debug_info);
+		}
+		else if(takes_value(argv[i])) {
+			++i;
+		}
 	}
 	return flags;
 }
 
+std::optional<std::string> find_option(int argc, char* argv[], const char* name) {
+	for(int i = 1;i + 1 < argc && argv[i][0] == '-';++i) {
+		if(strcmp(argv[i], name) == 0) {
+			return argv[i + 1];
+		}
+		if(takes_value(argv[i])) {
+			++i;
+		}
+	}
+	return std::nullopt;
+}
+
 bool find_flag(std::vector<Flags> flags, Flags f) {
 	return std::find(flags.begin(), flags.end(), f) != flags.end();
 }
 
+// lexes, parses and generates `input`, returns the output file contents
+std::string assemble(const std::string& input, bool object, bool debug_info, std::vector<std::string>& included)
+{
+	std::vector<Token> tokens = lex_file(input, included);
+
+	Parser parser(std::move(tokens));
+	std::optional<NodeProg> prog = parser.parse_prog();
+
+	if (!prog.has_value()) {
+		std::cerr << "Invalid program" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	Generator generator(std::move(prog.value()), debug_info);
+
+	if(object) {
+		return serialize_object(generator.gen_object());
+	}
+	generator.gen_prog();
+	return generator.image();
+}
+
 int main(int argc, char* argv[])
 {
 	if (argc < 2) {
@@ -42,40 +100,58 @@ int main(int argc, char* argv[])
 		return EXIT_FAILURE;
 	}
 
-	std::string contents;
-	{
-		std::stringstream contents_stream;
-		std::fstream input(argv[argc-1], std::ios::in);
-		contents_stream << input.rdbuf();
-		contents = contents_stream.str();
-	}
-
 	std::vector<Flags> flags = collect_flags(argc, argv);
+	const std::string input = argv[argc-1];
+	const bool object = find_flag(flags, Flags::object);
+	const bool debug = find_flag(flags, Flags::debug);
+	const bool run = debug || find_flag(flags, Flags::run);
+	// the in-process debugger shows source locations
+	const bool debug_info = debug || find_flag(flags, Flags::debug_info);
 
-	Lexer lexer(std::move(contents));
-	std::vector<Token> tokens = lexer.lex(argv[argc-1]);
-
-	Parser parser(std::move(tokens));
-	std::optional<NodeProg> prog = parser.parse_prog();
+	// running happens in memory, so only write a file when asked to
+	// or when it is the only result
+	std::optional<std::string> out_path = find_option(argc, argv, "-o");
+	if(!out_path.has_value() && object) {
+		out_path = std::filesystem::path(input).replace_extension(".yo").string();
+	}
+	else if(!out_path.has_value() && !run) {
+		out_path = "out.bin";
+	}
 
-	if (!prog.has_value()) {
-		std::cerr << "Invalid program" << std::endl;
-		exit(EXIT_FAILURE);
+	std::optional<std::string> cache_dir = find_option(argc, argv, "--cache");
+	if(!cache_dir.has_value() && getenv("YASM_CACHE") != NULL) {
+		cache_dir = getenv("YASM_CACHE");
+	}
+	std::optional<AssemblyCache> cache;
+	std::string cache_key;
+	if(cache_dir.has_value()) {
+		std::optional<std::string> source = read_source(input);
+		if(source.has_value()) {
+			cache.emplace(cache_dir.value());
+			cache_key = cache->key(source.value(), std::string(object ? "obj" : "bin") + (debug_info ? "-g" : ""));
+		}
 	}
 
-	Generator generator(prog.value());
-	generator.gen_prog();
+	std::optional<std::string> image;
+	if(cache.has_value()) {
+		image = cache->restore(cache_key, input);
+	}
+	if(!image.has_value()) {
+		std::vector<std::string> included;
+		image = assemble(input, object, debug_info, included);
+		if(cache.has_value()) {
+			cache->store(cache_key, input, included, image.value());
+		}
+	}
 
-	if(find_flag(flags, Flags::debug)) {
-		// run out.bin in YVM
-		// with enabled debuging
-		return system("yvm out.bin -d");
+	if(out_path.has_value() && !write_file(out_path.value(), image.value())) {
+		std::cerr << "ERROR: cannot write `" << out_path.value() << "`" << std::endl;
+		return EXIT_FAILURE;
 	}
 
-	if(find_flag(flags, Flags::run)) {
-		// run out.bin in YVM
-		return system("yvm out.bin");
+	if(object || !run) {
+		return EXIT_SUCCESS;
 	}
 
-	return EXIT_SUCCESS;
+	return yvm_run_image(image.value().data(), image.value().size(), debug);
 }
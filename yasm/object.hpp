@@ -0,0 +1,236 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "instr.hpp"
+
+// object file layout (little endian):
+//   "YO" u8 version u8 flags u32 code_count u32 symbol_count u32 reloc_count
+//   u32 data_size
+//   Instr code[code_count]
+//   u8 data[data_size]
+//   symbols: u32 addr, u32 in_data, u32 name_len, char name[name_len]
+//   relocs:  u32 index, u32 kind, u32 in_data, u32 name_len, char name[name_len]
+// a reloc in data patches the word at data[index]
+
+#define YOBJ_VERSION 2
+#define YOBJ_FLAG_ENTRY 1
+
+// data labels address memory from YBC_DATA_BASE up to the default stack
+// of yvm, an object's data addresses start at YBC_DATA_BASE too
+#define YBC_DATA_BASE 4096
+#define YBC_DATA_END 21000
+
+enum class RelocKind : uint32_t {
+	local = 0, // operand is an address inside this object
+	symbol = 1, // operand is the address of a global symbol
+	local_data = 2, // operand is a data address inside this object
+};
+
+struct ObjSymbol {
+	uint32_t addr;
+	bool in_data;
+	std::string name;
+};
+
+struct ObjReloc {
+	uint32_t index;
+	RelocKind kind;
+	bool in_data;
+	std::string symbol;
+};
+
+struct ObjectFile {
+	bool has_entry = false;
+	std::vector<Instr> code {};
+	std::vector<uint8_t> data {};
+	std::vector<ObjSymbol> symbols {};
+	std::vector<ObjReloc> relocs {};
+	std::string path {};
+};
+
+bool write_file(const std::string& path, const std::string& data) {
+	FILE* file = fopen(path.c_str(), "wb");
+	if(file == NULL) {
+		return false;
+	}
+	fwrite(data.data(), sizeof(char), data.size(), file);
+	fclose(file);
+	return true;
+}
+
+void __obj_put_u32(std::string& buf, uint32_t value) {
+	buf.append(reinterpret_cast<const char*>(&value), sizeof(uint32_t));
+}
+
+void __obj_put_str(std::string& buf, const std::string& str) {
+	__obj_put_u32(buf, static_cast<uint32_t>(str.size()));
+	buf.append(str);
+}
+
+struct DebugLine {
+	uint32_t addr;
+	uint32_t file;
+	uint32_t line;
+	uint32_t col;
+};
+
+struct DebugSym {
+	uint32_t addr;
+	uint32_t name;
+};
+
+// address to source mapping written with -g, see yvm/debuginfo.h
+struct DebugInfo {
+	std::vector<std::string> strings {};
+	std::vector<DebugLine> lines {};
+	std::vector<DebugSym> labels {};
+	std::vector<DebugSym> calls {};
+};
+
+#define YBC_HAS_DEBUG 1
+#define YBC_HAS_DATA 2
+
+// final bytecode image read by yvm:
+//   "YM" u8 flags u8 reserved u32 code_count, code, optional data section
+//   ("YI" u32 addr u32 size, bytes), optional debug section
+std::string serialize_bytecode(const Instr* code, size_t count, const DebugInfo* debug = nullptr, const std::vector<uint8_t>& data = {}) {
+	std::string buf("YM", 2);
+	buf.push_back(static_cast<char>((debug != nullptr ? YBC_HAS_DEBUG : 0) | (!data.empty() ? YBC_HAS_DATA : 0)));
+	buf.push_back('\0');
+	__obj_put_u32(buf, static_cast<uint32_t>(count));
+	buf.append(reinterpret_cast<const char*>(code), sizeof(Instr) * count);
+	if(!data.empty()) {
+		buf.append("YI", 2);
+		__obj_put_u32(buf, YBC_DATA_BASE);
+		__obj_put_u32(buf, static_cast<uint32_t>(data.size()));
+		buf.append(reinterpret_cast<const char*>(data.data()), data.size());
+	}
+	if(debug == nullptr) {
+		return buf;
+	}
+	buf.append("YD", 2);
+	__obj_put_u32(buf, static_cast<uint32_t>(debug->strings.size()));
+	for(const std::string& str : debug->strings) {
+		__obj_put_str(buf, str);
+	}
+	__obj_put_u32(buf, static_cast<uint32_t>(debug->lines.size()));
+	buf.append(reinterpret_cast<const char*>(debug->lines.data()), sizeof(DebugLine) * debug->lines.size());
+	__obj_put_u32(buf, static_cast<uint32_t>(debug->labels.size()));
+	buf.append(reinterpret_cast<const char*>(debug->labels.data()), sizeof(DebugSym) * debug->labels.size());
+	__obj_put_u32(buf, static_cast<uint32_t>(debug->calls.size()));
+	buf.append(reinterpret_cast<const char*>(debug->calls.data()), sizeof(DebugSym) * debug->calls.size());
+	return buf;
+}
+
+bool write_bytecode(const std::string& path, const Instr* code, size_t count, const std::vector<uint8_t>& data = {}) {
+	return write_file(path, serialize_bytecode(code, count, nullptr, data));
+}
+
+bool __obj_read_u32(FILE* file, uint32_t* value) {
+	return fread(value, sizeof(uint32_t), 1, file) == 1;
+}
+
+// bytes left after the current position, counts read from the file
+// are checked against it before anything is allocated for them
+uint64_t __obj_remaining(FILE* file) {
+	long pos = ftell(file);
+	if(pos < 0 || fseek(file, 0L, SEEK_END) != 0) {
+		return 0;
+	}
+	long end = ftell(file);
+	fseek(file, pos, SEEK_SET);
+	return end > pos ? static_cast<uint64_t>(end - pos) : 0;
+}
+
+bool __obj_read_str(FILE* file, std::string* str) {
+	uint32_t size;
+	if(!__obj_read_u32(file, &size) || size > __obj_remaining(file)) {
+		return false;
+	}
+	str->resize(size);
+	return fread(str->data(), sizeof(char), size, file) == size;
+}
+
+std::string serialize_object(const ObjectFile& obj) {
+	std::string buf;
+	char header[4] = { 'Y', 'O', YOBJ_VERSION, static_cast<char>(obj.has_entry ? YOBJ_FLAG_ENTRY : 0) };
+	buf.append(header, 4);
+	__obj_put_u32(buf, static_cast<uint32_t>(obj.code.size()));
+	__obj_put_u32(buf, static_cast<uint32_t>(obj.symbols.size()));
+	__obj_put_u32(buf, static_cast<uint32_t>(obj.relocs.size()));
+	__obj_put_u32(buf, static_cast<uint32_t>(obj.data.size()));
+	buf.append(reinterpret_cast<const char*>(obj.code.data()), sizeof(Instr) * obj.code.size());
+	buf.append(reinterpret_cast<const char*>(obj.data.data()), obj.data.size());
+	for(const ObjSymbol& sym : obj.symbols) {
+		__obj_put_u32(buf, sym.addr);
+		__obj_put_u32(buf, sym.in_data ? 1 : 0);
+		__obj_put_str(buf, sym.name);
+	}
+	for(const ObjReloc& rel : obj.relocs) {
+		__obj_put_u32(buf, rel.index);
+		__obj_put_u32(buf, static_cast<uint32_t>(rel.kind));
+		__obj_put_u32(buf, rel.in_data ? 1 : 0);
+		__obj_put_str(buf, rel.symbol);
+	}
+	return buf;
+}
+
+bool write_object(const std::string& path, const ObjectFile& obj) {
+	return write_file(path, serialize_object(obj));
+}
+
+std::optional<ObjectFile> read_object(const std::string& path) {
+	FILE* file = fopen(path.c_str(), "rb");
+	if(file == NULL) {
+		return std::nullopt;
+	}
+	ObjectFile obj;
+	obj.path = path;
+	char header[4];
+	uint32_t code_count, symbol_count, reloc_count, data_size;
+	bool ok = fread(header, sizeof(char), 4, file) == 4
+		&& header[0] == 'Y' && header[1] == 'O' && header[2] == YOBJ_VERSION
+		&& __obj_read_u32(file, &code_count)
+		&& __obj_read_u32(file, &symbol_count)
+		&& __obj_read_u32(file, &reloc_count)
+		&& __obj_read_u32(file, &data_size)
+		&& data_size <= YBC_DATA_END - YBC_DATA_BASE
+		&& sizeof(Instr) * static_cast<uint64_t>(code_count) + data_size <= __obj_remaining(file);
+	if(ok) {
+		obj.has_entry = (header[3] & YOBJ_FLAG_ENTRY) != 0;
+		obj.code.resize(code_count);
+		obj.data.resize(data_size);
+		ok = fread(obj.code.data(), sizeof(Instr), code_count, file) == code_count
+			&& fread(obj.data.data(), sizeof(uint8_t), data_size, file) == data_size;
+	}
+	for(uint32_t i = 0;ok && i < symbol_count;++i) {
+		ObjSymbol sym;
+		uint32_t in_data;
+		ok = __obj_read_u32(file, &sym.addr) && __obj_read_u32(file, &in_data) && __obj_read_str(file, &sym.name);
+		sym.in_data = in_data != 0;
+		obj.symbols.push_back(std::move(sym));
+	}
+	for(uint32_t i = 0;ok && i < reloc_count;++i) {
+		ObjReloc rel;
+		uint32_t kind;
+		uint32_t in_data;
+		ok = __obj_read_u32(file, &rel.index) && __obj_read_u32(file, &kind) && __obj_read_u32(file, &in_data)
+			&& __obj_read_str(file, &rel.symbol);
+		rel.kind = static_cast<RelocKind>(kind);
+		rel.in_data = in_data != 0;
+		if(ok && (rel.in_data ? static_cast<uint64_t>(rel.index) + 4 > data_size : rel.index >= code_count)) {
+			ok = false;
+		}
+		obj.relocs.push_back(std::move(rel));
+	}
+	fclose(file);
+	if(!ok) {
+		return std::nullopt;
+	}
+	return obj;
+}
@@ -1,117 +1,135 @@
 #pragma once
 
 #include <cassert>
-#include <variant>
+#include <cstdint>
 #include <filesystem>
+#include <string_view>
+#include <unordered_map>
 
 #include "arena.hpp"
+#include "instr.hpp"
 #include "lexer.hpp"
 
 #define yforeach(container) for(int i = 0;i < static_cast<int>(container.size());++i)
 
-struct NodeExprIntLit {
-	Token int_lit;
+enum class StmtKind : uint8_t {
+	push_int,
+	push_reg,
+	push_label,
+	pop,
+	mov_v0,
+	mov_v1,
+	syscall,
+	label,
+	jmp,
+	add,
+	sub,
+	mul,
+	div,
+	entry,
+	ipush,
+	bpush,
+	spush,
+	sjmp,
+	call,
+	global,
+	load,
+	store,
+	memcpy,
+	memset,
+	memcmp,
+	vadd,
+	vmul,
+	vsum,
+	jtab,
+	jtab_target,
+	// data directives, their bytes go to the data section
+	word,
+	word_label,
+	byte,
+	ascii,
+	zero,
 };
 
-struct NodeExprReg {
-	Token def;
-	std::string name;
+struct SourceLoc {
+	uint32_t file; // string id
+	int line;
+	int col;
 };
 
-struct NodeExprIdent {
-	Token ident;
-};
-
-struct NodeExpr {
-	std::variant<NodeExprIntLit*, NodeExprReg*, NodeExprIdent*> var;
-};
-
-struct NodeStmtPush {
-	Token def;
-	NodeExpr* expr;
-};
-
-struct NodeStmtMov {
-	Token def;
-	NodeExpr* to;
-	NodeExpr* expr;
-};
-
-struct NodeStmtPop {
-	Token def;
-	std::string reg;
-};
-
-struct NodeStmtSyscall {
-	Token def;
-};
-
-struct NodeStmtLabel {
-	Token def;
-	std::string name;
-};
-
-struct NodeStmtAdd {
-	Token def;
-};
-
-struct NodeStmtSub {
-	Token def;
-};
-
-struct NodeStmtMul {
-	Token def;
-};
+// interned strings (labels, file names), the characters live in an
+// arena so ids and views stay valid for the lifetime of the table
+class StringTable {
+public:
+	StringTable() = default;
 
-struct NodeStmtDiv {
-	Token def;
-};
+	uint32_t intern(std::string_view str)
+	{
+		auto it = m_ids.find(str);
+		if(it != m_ids.end()) {
+			return it->second;
+		}
+		char* chars = m_arena.alloc_array<char>(str.size());
+		std::copy(str.begin(), str.end(), chars);
+		std::string_view stored(chars, str.size());
+		uint32_t id = static_cast<uint32_t>(m_strings.size());
+		m_strings.push_back(stored);
+		m_ids.emplace(stored, id);
+		return id;
+	}
 
-struct NodeStmtIpush {
-	Token def;
-};
+	std::string_view get(uint32_t id) const
+	{
+		return m_strings[id];
+	}
 
-struct NodeStmtBpush {
-	Token def;
-};
+	size_t size() const
+	{
+		return m_strings.size();
+	}
 
-struct NodeStmtSpush {
-	Token def;
-};
+	ArenaAllocator::Stats memory() const
+	{
+		return m_arena.stats();
+	}
 
-struct NodeStmtSjmp {
-	Token def;
+private:
+	ArenaAllocator m_arena;
+	std::vector<std::string_view> m_strings;
+	std::unordered_map<std::string_view, uint32_t> m_ids;
 };
 
-struct NodeStmtJmp {
-	Token def;
-	std::string label;
-};
+// the program is a table of statements stored as parallel arrays,
+// `operands[i]` is an int literal, a register number or a string id
+// depending on `kinds[i]`
+struct NodeProg {
+	std::vector<StmtKind> kinds {};
+	std::vector<int> operands {};
+	std::vector<SourceLoc> locs {};
+	StringTable strings {};
 
-struct NodeStmtEntry {
-	Token def;
-	std::string name;
-};
+	size_t size() const
+	{
+		return kinds.size();
+	}
 
-struct NodeStmtCall {
-	Token def;
-	std::optional<NodeExpr*> expr;
-};
+	void add(StmtKind kind, int operand, SourceLoc loc)
+	{
+		kinds.push_back(kind);
+		operands.push_back(operand);
+		locs.push_back(loc);
+	}
 
-struct NodeStmt {
-	std::variant<NodeStmtPush*, NodeStmtMov*,
-				NodeStmtPop*, NodeStmtSyscall*,
-				NodeStmtLabel*, NodeStmtJmp*,
-				NodeStmtAdd*, NodeStmtSub*,
-				NodeStmtMul*, NodeStmtDiv*,
-				NodeStmtEntry*, NodeStmtIpush*,
-				NodeStmtSpush*, NodeStmtBpush*,
-				NodeStmtSjmp*, NodeStmtCall*> var;
+	std::string_view str(size_t stmt) const
+	{
+		return strings.get(static_cast<uint32_t>(operands[stmt]));
+	}
 };
 
-struct NodeProg {
-	std::vector<NodeStmt*> stmts {};
-};
+void putloc(const NodeProg& prog, SourceLoc loc) {
+	std::string_view file = prog.strings.get(loc.file);
+	printf("%.*s %d:%d", static_cast<int>(file.size()), file.data(), loc.line, loc.col);
+}
 
 bool file_exists(std::string name) {
 	if(FILE *file = fopen(name.c_str(), "r")) {
@@ -122,244 +140,334 @@ bool file_exists(std::string name) {
 	}
 }
 
+int __reg_to_no(std::string_view reg) {
+	if(reg == "v0") {
+		return REG_V0;
+	}
+	if(reg == "v1") {
+		return REG_V1;
+	}
+	assert(false && "unkown register");
+	return REG_V0;
+}
+
 class Parser {
 public:
 	explicit Parser(std::vector<Token> tokens)
 		: m_tokens(std::move(tokens))
-		, m_allocator(1024 * 1024 * 24) // 24 mb
+		, m_syscalls({ { "dump_state", 0 }, { "dump_v1", 1 }, { "exit", 2 }, { "snapshot", 3 },
+			{ "io_open", 4 }, { "io_read", 5 }, { "io_write", 6 }, { "io_wait", 7 }, { "io_close", 8 },
+			{ "map", 9 }, { "unmap", 10 } })
 	{
+		m_prog.kinds.reserve(m_tokens.size() / 2);
+		m_prog.operands.reserve(m_tokens.size() / 2);
+		m_prog.locs.reserve(m_tokens.size() / 2);
 	}
 
 	void ParsingError(const std::string& msg, const int pos = 0) const
 	{
-		putloc(peek(pos).value());
+		putloc(*peek(pos));
 		std::cout << " ERROR: " << msg << "\n";
 		exit(EXIT_FAILURE);
 	}
 
 	void error_expected(const std::string& msg) const
 	{
-		putloc(peek(-1).value());
-		if(peek().has_value()) {
-			std::cout << " ERROR: excepted " << msg << ", but got " << tok_to_string(peek().value().type) << "\n";
+		putloc(*peek(-1));
+		if(peek() != nullptr) {
+			std::cout << " ERROR: excepted " << msg << ", but got " << tok_to_string(peek()->type) << "\n";
 		} else {
 			std::cout << " ERROR: excepted " << msg << ", but got nothing\n";
 		}
 		exit(EXIT_FAILURE);
 	}
 
-	std::optional<NodeExpr*> parse_expr() // NOLINT(*-no-recursion)
+	SourceLoc loc(const Token& tok)
 	{
-		if(auto int_lit = try_consume(TokenType::int_lit)) {
-			auto expr_int = m_allocator.emplace<NodeExprIntLit>(int_lit.value());
-			auto expr = m_allocator.emplace<NodeExpr>(expr_int);
-			return expr;
+		if(m_last_file.data() == nullptr || tok.file != m_last_file) {
+			m_last_file_id = m_prog.strings.intern(tok.file);
+			m_last_file = m_prog.strings.get(m_last_file_id);
 		}
-		if(auto _reg = try_consume(TokenType::reg)) {
-			auto expr_reg = m_allocator.emplace<NodeExprReg>();
-			expr_reg->def = _reg.value();
-			expr_reg->name = _reg.value().value.value();
-			auto expr = m_allocator.emplace<NodeExpr>(expr_reg);
-			return expr;
+		return { .file = m_last_file_id, .line = tok.line, .col = tok.col };
+	}
+
+	// number of a syscall named by `sysdef` or one of the builtins
+	int syscall_no(const Token& name) const
+	{
+		auto it = m_syscalls.find(name.value.value());
+		if(it == m_syscalls.end()) {
+			putloc(name);
+			std::cout << " ERROR: unknown syscall `" << name.value.value() << "`\n";
+			exit(EXIT_FAILURE);
 		}
-		if(auto ident = try_consume(TokenType::ident)) {
-			auto expr_ident = m_allocator.emplace<NodeExprIdent>();
-			expr_ident->ident = ident.value();
-			auto expr = m_allocator.emplace<NodeExpr>(expr_ident);
-			return expr;
+		return it->second;
+	}
+
+	// \n, \t, \0 and \\ in a string literal
+	static std::string unescape(const std::string& str)
+	{
+		std::string out;
+		out.reserve(str.size());
+		for(size_t i = 0;i < str.size();++i) {
+			if(str[i] != '\\' || i + 1 == str.size()) {
+				out.push_back(str[i]);
+				continue;
+			}
+			switch(str[++i]) {
+			case 'n': out.push_back('\n'); break;
+			case 't': out.push_back('\t'); break;
+			case '0': out.push_back('\0'); break;
+			default:  out.push_back(str[i]); break;
+			}
 		}
-		return {};
+		return out;
 	}
 
-	std::optional<NodeStmt*> parse_stmt() // NOLINT(*-no-recursion)
+	int intern(const Token& tok)
 	{
-		if(auto _push = try_consume(TokenType::push)) {
-			auto push_stmt = m_allocator.emplace<NodeStmtPush>();
-			push_stmt->def = _push.value();
-			if(auto expr = parse_expr()) {
-				push_stmt->expr = expr.value();
-			} else {
+		return static_cast<int>(m_prog.strings.intern(tok.value.value()));
+	}
+
+	bool parse_stmt()
+	{
+		if(const Token* push = try_consume(TokenType::push)) {
+			if(const Token* int_lit = try_consume(TokenType::int_lit)) {
+				m_prog.add(StmtKind::push_int, std::stoi(int_lit->value.value()), loc(*push));
+			}
+			else if(const Token* reg = try_consume(TokenType::reg)) {
+				m_prog.add(StmtKind::push_reg, __reg_to_no(reg->value.value()), loc(*push));
+			}
+			else if(const Token* ident = try_consume(TokenType::ident)) {
+				m_prog.add(StmtKind::push_label, intern(*ident), loc(*ident));
+			}
+			else {
 				error_expected("expression");
 			}
-			auto stmt = m_allocator.emplace<NodeStmt>(push_stmt);
-			return stmt;
+			return true;
 		}
 
-		if(auto _pop = try_consume(TokenType::pop)) {
-			auto pop_stmt = m_allocator.emplace<NodeStmtPop>();
-			pop_stmt->def = _pop.value();
-			pop_stmt->reg = try_consume_err(TokenType::reg).value.value();
-			auto stmt = m_allocator.emplace<NodeStmt>(pop_stmt);
-			return stmt;
+		if(const Token* pop = try_consume(TokenType::pop)) {
+			const Token& reg = try_consume_err(TokenType::reg);
+			m_prog.add(StmtKind::pop, __reg_to_no(reg.value.value()), loc(*pop));
+			return true;
 		}
 
-		if(auto _mov = try_consume(TokenType::mov)) {
-			auto mov_stmt = m_allocator.emplace<NodeStmtMov>();
-			mov_stmt->def = _mov.value();
-			if(auto expr = parse_expr()) {
-				mov_stmt->to = expr.value();
-			} else {
-				error_expected("expression");
+		if(const Token* mov = try_consume(TokenType::mov)) {
+			const Token* reg = try_consume(TokenType::reg);
+			if(reg == nullptr) {
+				putloc(*mov);
+				std::cout << " ERROR: except register at left\n";
+				exit(EXIT_FAILURE);
 			}
 			try_consume_err(TokenType::comma);
-			if(auto expr = parse_expr()) {
-				mov_stmt->expr = expr.value();
-			} else {
-				error_expected("expression");
+			StmtKind kind = __reg_to_no(reg->value.value()) == REG_V0 ? StmtKind::mov_v0 : StmtKind::mov_v1;
+			if(const Token* int_lit = try_consume(TokenType::int_lit)) {
+				m_prog.add(kind, std::stoi(int_lit->value.value()), loc(*mov));
 			}
-			auto stmt = m_allocator.emplace<NodeStmt>(mov_stmt);
-			return stmt;
+			else if(const Token* name = try_consume(TokenType::ident)) {
+				m_prog.add(kind, syscall_no(*name), loc(*mov));
+			}
+			else {
+				putloc(*mov);
+				std::cout << " ERROR: except int literal or syscall name at right\n";
+				exit(EXIT_FAILURE);
+			}
+			return true;
 		}
 
-		if(auto syscall = try_consume(TokenType::syscall)) {
-			auto syscall_stmt = m_allocator.emplace<NodeStmtSyscall>();
-			syscall_stmt->def = syscall.value();
-			auto stmt = m_allocator.emplace<NodeStmt>(syscall_stmt);
-			return stmt;
+		// `syscall name` and `syscall 5` load v0 first
+		if(peek() != nullptr && peek()->type == TokenType::syscall && peek(1) != nullptr
+			&& (peek(1)->type == TokenType::int_lit || (peek(1)->type == TokenType::ident
+				&& (peek(2) == nullptr || peek(2)->type != TokenType::double_dot)))) {
+			const Token& syscall = consume();
+			const Token& no = consume();
+			int value = no.type == TokenType::int_lit ? std::stoi(no.value.value()) : syscall_no(no);
+			m_prog.add(StmtKind::mov_v0, value, loc(syscall));
+			m_prog.add(StmtKind::syscall, 0, loc(syscall));
+			return true;
 		}
 
-		if(auto _add = try_consume(TokenType::add)) {
-			auto add_stmt = m_allocator.emplace<NodeStmtAdd>();
-			add_stmt->def = _add.value();
-			auto stmt = m_allocator.emplace<NodeStmt>(add_stmt);
-			return stmt;
+		if(const Token* sysdef = try_consume(TokenType::sysdef)) {
+			const Token& name = try_consume_err(TokenType::ident);
+			try_consume(TokenType::comma);
+			const Token& no = try_consume_err(TokenType::int_lit);
+			auto [it, inserted] = m_syscalls.try_emplace(name.value.value(), std::stoi(no.value.value()));
+			if(!inserted && it->second != std::stoi(no.value.value())) {
+				putloc(*sysdef);
+				std::cout << " ERROR: syscall `" << name.value.value() << "` is already defined as " << it->second << "\n";
+				exit(EXIT_FAILURE);
+			}
+			return true;
 		}
 
-		if(auto _sub = try_consume(TokenType::sub)) {
-			auto sub_stmt = m_allocator.emplace<NodeStmtSub>();
-			sub_stmt->def = _sub.value();
-			auto stmt = m_allocator.emplace<NodeStmt>(sub_stmt);
-			return stmt;
+		if(const Token* jmp = try_consume(TokenType::jmp)) {
+			const Token& label = try_consume_err(TokenType::ident);
+			m_prog.add(StmtKind::jmp, intern(label), loc(*jmp));
+			return true;
 		}
 
-		if(auto _mul = try_consume(TokenType::mul)) {
-			auto mul_stmt = m_allocator.emplace<NodeStmtMul>();
-			mul_stmt->def = _mul.value();
-			auto stmt = m_allocator.emplace<NodeStmt>(mul_stmt);
-			return stmt;
+		// `jtab default, l0, l1, ...` jumps to l<index> for the index
+		// popped from the stack, or to default when it is out of range
+		if(const Token* jtab = try_consume(TokenType::jtab)) {
+			const Token& fallback = try_consume_err(TokenType::ident);
+			std::vector<const Token*> targets;
+			while(try_consume(TokenType::comma) != nullptr) {
+				targets.push_back(&try_consume_err(TokenType::ident));
+			}
+			m_prog.add(StmtKind::jtab, static_cast<int>(targets.size()), loc(*jtab));
+			m_prog.add(StmtKind::jtab_target, intern(fallback), loc(fallback));
+			for(const Token* target : targets) {
+				m_prog.add(StmtKind::jtab_target, intern(*target), loc(*target));
+			}
+			return true;
 		}
 
-		if(auto _div = try_consume(TokenType::div)) {
-			auto div_stmt = m_allocator.emplace<NodeStmtDiv>();
-			div_stmt->def = _div.value();
-			auto stmt = m_allocator.emplace<NodeStmt>(div_stmt);
-			return stmt;
+		// `.word 1, label` and `.byte 1, 2` take lists, `.ascii "text"`
+		// and `.zero n` one operand. a label in front names the data
+		if(try_consume(TokenType::word) != nullptr) {
+			do {
+				if(const Token* label = try_consume(TokenType::ident)) {
+					m_prog.add(StmtKind::word_label, intern(*label), loc(*label));
+					continue;
+				}
+				const Token& value = try_consume_err(TokenType::int_lit);
+				m_prog.add(StmtKind::word, std::stoi(value.value.value()), loc(value));
+			} while(try_consume(TokenType::comma) != nullptr);
+			return true;
 		}
 
-		if(auto _jmp = try_consume(TokenType::jmp)) {
-			auto jmp_stmt = m_allocator.emplace<NodeStmtJmp>();
-			jmp_stmt->def = _jmp.value();
-			jmp_stmt->label = try_consume_err(TokenType::ident).value.value();
-			auto stmt = m_allocator.emplace<NodeStmt>(jmp_stmt);
-			return stmt;
+		if(try_consume(TokenType::byte) != nullptr) {
+			do {
+				const Token& value = try_consume_err(TokenType::int_lit);
+				int byte = std::stoi(value.value.value());
+				if(byte > 255) {
+					putloc(value);
+					std::cout << " ERROR: byte value " << byte << " is out of range\n";
+					exit(EXIT_FAILURE);
+				}
+				m_prog.add(StmtKind::byte, byte, loc(value));
+			} while(try_consume(TokenType::comma) != nullptr);
+			return true;
 		}
 
-		if(auto _call = try_consume(TokenType::call)) {
-			auto call_stmt = m_allocator.emplace<NodeStmtCall>();
-			call_stmt->def = _call.value();
-			if(auto expr = parse_expr()) {
-				call_stmt->expr = expr;
-			} else {
-				call_stmt->expr = std::nullopt;
-			}
-			auto stmt = m_allocator.emplace<NodeStmt>(call_stmt);
-			return stmt;
+		if(try_consume(TokenType::ascii) != nullptr) {
+			const Token& text = try_consume_err(TokenType::string_lit);
+			m_prog.add(StmtKind::ascii, static_cast<int>(m_prog.strings.intern(unescape(text.value.value()))), loc(text));
+			return true;
 		}
 
-		if(auto _ipush = try_consume(TokenType::ipush)) {
-			auto ipush_stmt = m_allocator.emplace<NodeStmtIpush>();
-			ipush_stmt->def = _ipush.value();
-			auto stmt = m_allocator.emplace<NodeStmt>(ipush_stmt);
-			return stmt;
+		if(const Token* zero = try_consume(TokenType::zero)) {
+			const Token& count = try_consume_err(TokenType::int_lit);
+			m_prog.add(StmtKind::zero, std::stoi(count.value.value()), loc(*zero));
+			return true;
 		}
 
-		if(auto _spush = try_consume(TokenType::spush)) {
-			auto spush_stmt = m_allocator.emplace<NodeStmtSpush>();
-			spush_stmt->def = _spush.value();
-			auto stmt = m_allocator.emplace<NodeStmt>(spush_stmt);
-			return stmt;
+		if(const Token* call = try_consume(TokenType::call)) {
+			if(peek() == nullptr || peek()->type != TokenType::ident) {
+				putloc(*call);
+				std::cout << " ERROR: call from stack not supported\n"; // TODO: add support for with
+				exit(EXIT_FAILURE);
+			}
+			const Token& label = consume();
+			m_prog.add(StmtKind::call, intern(label), loc(*call));
+			return true;
 		}
 
-		if(auto _bpush = try_consume(TokenType::bpush)) {
-			auto bpush_stmt = m_allocator.emplace<NodeStmtBpush>();
-			bpush_stmt->def = _bpush.value();
-			auto stmt = m_allocator.emplace<NodeStmt>(bpush_stmt);
-			return stmt;
+		if(const Token* entry = try_consume(TokenType::entry)) {
+			const Token& name = try_consume_err(TokenType::ident);
+			m_prog.add(StmtKind::entry, intern(name), loc(*entry));
+			return true;
 		}
 
-		if(auto _sjmp = try_consume(TokenType::sjmp)) {
-			auto sjmp_stmt = m_allocator.emplace<NodeStmtSjmp>();
-			sjmp_stmt->def = _sjmp.value();
-			auto stmt = m_allocator.emplace<NodeStmt>(sjmp_stmt);
-			return stmt;
+		if(const Token* global = try_consume(TokenType::global)) {
+			const Token& name = try_consume_err(TokenType::ident);
+			m_prog.add(StmtKind::global, intern(name), loc(*global));
+			return true;
 		}
 
-		if(auto label = try_consume(TokenType::ident)) {
+		if(const Token* label = try_consume(TokenType::ident)) {
 			try_consume_err(TokenType::double_dot);
-			auto label_stmt = m_allocator.emplace<NodeStmtLabel>();
-			label_stmt->def = label.value();
-			label_stmt->name = label.value().value.value();
-			auto stmt = m_allocator.emplace<NodeStmt>(label_stmt);
-			return stmt;
+			m_prog.add(StmtKind::label, intern(*label), loc(*label));
+			return true;
 		}
 
-		if(auto entry = try_consume(TokenType::entry)) {
-			auto entry_stmt = m_allocator.emplace<NodeStmtEntry>();
-			entry_stmt->def = entry.value();
-			entry_stmt->name = try_consume_err(TokenType::ident).value.value();
-			auto stmt = m_allocator.emplace<NodeStmt>(entry_stmt);
-			return stmt;
+		if(peek() == nullptr) {
+			return false;
 		}
-
-		return {};
+		// statements without operands
+		const Token& tok = *peek();
+		StmtKind kind;
+		switch(tok.type) {
+		case TokenType::syscall: kind = StmtKind::syscall; break;
+		case TokenType::add:     kind = StmtKind::add;     break;
+		case TokenType::sub:     kind = StmtKind::sub;     break;
+		case TokenType::mul:     kind = StmtKind::mul;     break;
+		case TokenType::div:     kind = StmtKind::div;     break;
+		case TokenType::ipush:   kind = StmtKind::ipush;   break;
+		case TokenType::spush:   kind = StmtKind::spush;   break;
+		case TokenType::bpush:   kind = StmtKind::bpush;   break;
+		case TokenType::sjmp:    kind = StmtKind::sjmp;    break;
+		case TokenType::load:    kind = StmtKind::load;    break;
+		case TokenType::store:   kind = StmtKind::store;   break;
+		case TokenType::memcpy:  kind = StmtKind::memcpy;  break;
+		case TokenType::memset:  kind = StmtKind::memset;  break;
+		case TokenType::memcmp:  kind = StmtKind::memcmp;  break;
+		case TokenType::vadd:    kind = StmtKind::vadd;    break;
+		case TokenType::vmul:    kind = StmtKind::vmul;    break;
+		case TokenType::vsum:    kind = StmtKind::vsum;    break;
+		default:
+			return false;
+		}
+		consume();
+		m_prog.add(kind, 0, loc(tok));
+		return true;
 	}
 
 	std::optional<NodeProg> parse_prog()
 	{
-		NodeProg prog;
-		while (peek().has_value()) {
-			if (auto stmt = parse_stmt()) {
-				prog.stmts.push_back(stmt.value());
-			}
-			else {
+		while (peek() != nullptr) {
+			if (!parse_stmt()) {
 				error_expected("statement");
 			}
 		}
-		return prog;
+		return std::move(m_prog);
 	}
 
 private:
-	[[nodiscard]] std::optional<Token> peek(const int offset = 0) const
+	[[nodiscard]] const Token* peek(const int offset = 0) const
 	{
 		if (m_index + offset >= m_tokens.size()) {
-			return {};
+			return nullptr;
 		}
-		return m_tokens.at(m_index + offset);
+		return &m_tokens[m_index + offset];
 	}
 
-	Token consume()
+	const Token& consume()
 	{
-		return m_tokens.at(m_index++);
+		return m_tokens[m_index++];
 	}
 
-	Token try_consume_err(const TokenType type)
+	const Token& try_consume_err(const TokenType type)
 	{
-		if (peek().has_value() && peek().value().type == type) {
+		if (peek() != nullptr && peek()->type == type) {
 			return consume();
 		}
 		error_expected(tok_to_string(type));
-		return {};
+		return m_tokens[0];
 	}
 
-	std::optional<Token> try_consume(const TokenType type)
+	const Token* try_consume(const TokenType type)
 	{
-		if (peek().has_value() && peek().value().type == type) {
-			return consume();
+		if (peek() != nullptr && peek()->type == type) {
+			return &consume();
 		}
-		return {};
+		return nullptr;
 	}
 
 	std::vector<Token> m_tokens;
 	size_t m_index = 0;
-	ArenaAllocator m_allocator;
-};
\ No newline at end of file
+	NodeProg m_prog;
+	std::unordered_map<std::string, int> m_syscalls;
+	std::string_view m_last_file;
+	uint32_t m_last_file_id = 0;
+};
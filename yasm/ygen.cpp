@@ -0,0 +1,201 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// ygen: writes synthetic yasm sources for benchmarking the assembler.
+// the output always assembles: every referenced label is defined, and
+// labels referenced past the last statement are emitted at the end.
+// percentages are per statement, the same seed gives the same file.
+
+void usage(std::ostream& stream) {
+	stream << "Incorrect usage. Correct usage is..." << std::endl;
+	stream << "ygen [flags]" << std::endl;
+	stream << "flags:" << std::endl;
+	stream << "    -o <path>            output file (default: stdout)" << std::endl;
+	stream << "    --stmts <n>          number of statements (default 100000)" << std::endl;
+	stream << "    --kb <n>             stop at n KB of source instead" << std::endl;
+	stream << "    --label-every <n>    a label every n statements, 0 for none (default 16)" << std::endl;
+	stream << "    --refs <pct>         jmp/call/push of a label (default 10)" << std::endl;
+	stream << "    --forward <pct>      references to a later label (default 50)" << std::endl;
+	stream << "    --comments <pct>     statements followed by a comment (default 10)" << std::endl;
+	stream << "    --chars <pct>        pushes of a char literal (default 20)" << std::endl;
+	stream << "    --seed <n>           (default 1)" << std::endl;
+	stream << "    --shape <name>       preset: straight, labels, forward, comments, mixed" << std::endl;
+}
+
+struct Shape {
+	uint64_t stmts = 100000;
+	uint64_t kb = 0;
+	uint32_t label_every = 16;
+	uint32_t refs = 10;
+	uint32_t forward = 50;
+	uint32_t comments = 10;
+	uint32_t chars = 20;
+	uint64_t seed = 1;
+};
+
+bool apply_preset(Shape& shape, const char* name) {
+	if(strcmp(name, "straight") == 0) {
+		shape.label_every = 0;
+		shape.refs = 0;
+		shape.comments = 0;
+		shape.chars = 0;
+	}
+	else if(strcmp(name, "labels") == 0) {
+		shape.label_every = 2;
+		shape.refs = 25;
+		shape.forward = 50;
+	}
+	else if(strcmp(name, "forward") == 0) {
+		shape.label_every = 8;
+		shape.refs = 40;
+		shape.forward = 100;
+	}
+	else if(strcmp(name, "comments") == 0) {
+		shape.comments = 100;
+		shape.chars = 60;
+	}
+	else if(strcmp(name, "mixed") != 0) {
+		return false;
+	}
+	return true;
+}
+
+// xorshift64*, std distributions differ between standard libraries
+class Rng {
+public:
+	explicit Rng(uint64_t seed)
+		: m_state(seed == 0 ? 0x9e3779b97f4a7c15ULL : seed)
+	{
+	}
+
+	uint32_t below(uint32_t n)
+	{
+		m_state ^= m_state >> 12;
+		m_state ^= m_state << 25;
+		m_state ^= m_state >> 27;
+		return static_cast<uint32_t>((m_state * 0x2545f4914f6cdd1dULL) >> 32) % n;
+	}
+
+	bool chance(uint32_t pct)
+	{
+		return below(100) < pct;
+	}
+
+private:
+	uint64_t m_state;
+};
+
+const char* const comment_words[] = { "load", "the", "next", "value", "from", "stack", "frame", "and", "keep", "it" };
+const char* const chars[] = { "'a'", "'z'", "'0'", "'Y'", "' '", "'\\n'", "'#'", "'q'" };
+
+std::string comment(Rng& rng) {
+	std::string text = " ; ";
+	uint32_t words = 2 + rng.below(6);
+	for(uint32_t i = 0;i < words;++i) {
+		text += comment_words[rng.below(10)];
+		text += i + 1 < words ? " " : "";
+	}
+	return text;
+}
+
+// one statement without label operands
+std::string plain_stmt(Rng& rng, const Shape& shape) {
+	switch(rng.below(12)) {
+	case 0:
+	case 1:
+	case 2:
+		if(rng.chance(shape.chars)) {
+			return std::string("push ") + chars[rng.below(8)];
+		}
+		return "push " + std::to_string(rng.below(100000));
+	case 3: return "push v0";
+	case 4: return rng.below(2) == 0 ? "pop v0" : "pop v1";
+	case 5: return "add";
+	case 6: return "sub";
+	case 7: return "mul";
+	case 8: return "div";
+	case 9: return "mov v1, " + std::to_string(rng.below(1000));
+	case 10: return rng.below(2) == 0 ? "ipush" : "spush";
+	default: return "syscall dump_v1";
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	Shape shape;
+	const char* out_path = nullptr;
+	for(int i = 1;i < argc;++i) {
+		const bool has_value = i + 1 < argc;
+		if(strcmp(argv[i], "-o") == 0 && has_value) {
+			out_path = argv[++i];
+		}
+		else if(strcmp(argv[i], "--shape") == 0 && has_value) {
+			if(!apply_preset(shape, argv[++i])) {
+				std::cerr << "ERROR: unknown shape `" << argv[i] << "`" << std::endl;
+				return EXIT_FAILURE;
+			}
+		}
+		else if(strcmp(argv[i], "--stmts") == 0 && has_value) shape.stmts = strtoull(argv[++i], nullptr, 10);
+		else if(strcmp(argv[i], "--kb") == 0 && has_value) shape.kb = strtoull(argv[++i], nullptr, 10);
+		else if(strcmp(argv[i], "--label-every") == 0 && has_value) shape.label_every = static_cast<uint32_t>(atoi(argv[++i]));
+		else if(strcmp(argv[i], "--refs") == 0 && has_value) shape.refs = static_cast<uint32_t>(atoi(argv[++i]));
+		else if(strcmp(argv[i], "--forward") == 0 && has_value) shape.forward = static_cast<uint32_t>(atoi(argv[++i]));
+		else if(strcmp(argv[i], "--comments") == 0 && has_value) shape.comments = static_cast<uint32_t>(atoi(argv[++i]));
+		else if(strcmp(argv[i], "--chars") == 0 && has_value) shape.chars = static_cast<uint32_t>(atoi(argv[++i]));
+		else if(strcmp(argv[i], "--seed") == 0 && has_value) shape.seed = strtoull(argv[++i], nullptr, 10);
+		else {
+			usage(std::cerr);
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::string src = ";; generated by ygen\nentry main\nmain:\n";
+	Rng rng(shape.seed);
+	uint64_t label = 0; // labels emitted so far, L0 is the first
+	uint64_t max_ref = 0; // one past the highest referenced label
+	const uint64_t limit = shape.kb > 0 ? shape.kb * 1024 : 0;
+	for(uint64_t n = 0;limit > 0 ? src.size() < limit : n < shape.stmts;++n) {
+		if(shape.label_every > 0 && n % shape.label_every == 0) {
+			src += "L" + std::to_string(label++) + ":\n";
+		}
+		std::string stmt;
+		if(rng.chance(shape.refs)) {
+			std::string target = "main";
+			if(shape.label_every > 0) {
+				uint64_t to = rng.chance(shape.forward) ? label + rng.below(8) : rng.below(static_cast<uint32_t>(label));
+				max_ref = std::max(max_ref, to + 1);
+				target = "L" + std::to_string(to);
+			}
+			const char* op = rng.below(3) == 0 ? "call " : rng.below(2) == 0 ? "jmp " : "push ";
+			stmt = op + target;
+		} else {
+			stmt = plain_stmt(rng, shape);
+		}
+		src += "    " + stmt;
+		if(rng.chance(shape.comments)) {
+			src += comment(rng);
+		}
+		src += '\n';
+	}
+	while(label < max_ref) {
+		src += "L" + std::to_string(label++) + ":\n";
+	}
+	src += "    syscall exit\n";
+
+	if(out_path == nullptr) {
+		std::cout << src;
+		return EXIT_SUCCESS;
+	}
+	std::ofstream out(out_path, std::ios::binary);
+	out << src;
+	if(!out.good()) {
+		std::cerr << "ERROR: cannot write `" << out_path << "`" << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
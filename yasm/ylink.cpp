@@ -0,0 +1,131 @@
+#include <iostream>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+
+#include "object.hpp"
+
+void usage(std::ostream& stream) {
+	stream << "Incorrect usage. Correct usage is..." << std::endl;
+	stream << "ylink [-o <output.bin>] <input.yo> ..." << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	std::string out_path = "out.bin";
+	std::vector<ObjectFile> objects;
+	for(int i = 1;i < argc;++i) {
+		if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+			out_path = argv[++i];
+			continue;
+		}
+		std::optional<ObjectFile> obj = read_object(argv[i]);
+		if(!obj.has_value()) {
+			std::cerr << "ERROR: `" << argv[i] << "` is not a valid yasm object file" << std::endl;
+			return EXIT_FAILURE;
+		}
+		objects.push_back(std::move(obj.value()));
+	}
+	if(objects.empty()) {
+		usage(std::cerr);
+		return EXIT_FAILURE;
+	}
+
+	// the object with `entry` goes first so its jump sits at address 0
+	int entry_obj = -1;
+	for(int i = 0;i < static_cast<int>(objects.size());++i) {
+		if(!objects[i].has_entry) {
+			continue;
+		}
+		if(entry_obj != -1) {
+			std::cerr << "ERROR: entry provided by both `" << objects[entry_obj].path << "` and `" << objects[i].path << "`" << std::endl;
+			return EXIT_FAILURE;
+		}
+		entry_obj = i;
+	}
+	if(entry_obj == -1) {
+		std::cerr << "entry not provided!\n";
+		return EXIT_FAILURE;
+	}
+	std::swap(objects[0], objects[entry_obj]);
+
+	// the data sections are laid out in the same order, each starting
+	// on a word boundary
+	std::vector<uint32_t> bases;
+	std::vector<uint32_t> data_bases;
+	std::unordered_map<std::string, uint32_t> globals;
+	std::unordered_map<std::string, std::string> defined_in;
+	uint32_t base = 0;
+	uint32_t data_base = 0;
+	for(const ObjectFile& obj : objects) {
+		bases.push_back(base);
+		data_bases.push_back(data_base);
+		for(const ObjSymbol& sym : obj.symbols) {
+			if(globals.count(sym.name) != 0) {
+				std::cerr << "ERROR: multiple definition of `" << sym.name << "` in `" << defined_in[sym.name] << "` and `" << obj.path << "`" << std::endl;
+				return EXIT_FAILURE;
+			}
+			globals[sym.name] = (sym.in_data ? data_base : base) + sym.addr;
+			defined_in[sym.name] = obj.path;
+		}
+		base += static_cast<uint32_t>(obj.code.size());
+		data_base += (static_cast<uint32_t>(obj.data.size()) + 3) & ~3u;
+	}
+	if(data_base > YBC_DATA_END - YBC_DATA_BASE) {
+		std::cerr << "ERROR: data section is larger than " << YBC_DATA_END - YBC_DATA_BASE << " bytes" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::vector<Instr> image;
+	std::vector<uint8_t> data;
+	image.reserve(base);
+	data.reserve(data_base);
+	bool ok = true;
+	for(size_t i = 0;i < objects.size();++i) {
+		ObjectFile& obj = objects[i];
+		for(const ObjReloc& rel : obj.relocs) {
+			int operand = 0;
+			int* at = &operand;
+			if(rel.in_data) {
+				memcpy(&operand, obj.data.data() + rel.index, sizeof(int));
+			} else {
+				at = &obj.code[rel.index].operand;
+			}
+			if(rel.kind == RelocKind::local) {
+				*at += static_cast<int>(bases[i]);
+			}
+			else if(rel.kind == RelocKind::local_data) {
+				*at += static_cast<int>(data_bases[i]);
+			}
+			else {
+				auto it = globals.find(rel.symbol);
+				if(it == globals.end()) {
+					std::cerr << obj.path << " ERROR: undefined symbol `" << rel.symbol << "`" << std::endl;
+					ok = false;
+					continue;
+				}
+				*at = static_cast<int>(it->second);
+			}
+			if(rel.in_data) {
+				memcpy(obj.data.data() + rel.index, &operand, sizeof(int));
+			}
+		}
+		image.insert(image.end(), obj.code.begin(), obj.code.end());
+		if(!obj.data.empty()) {
+			data.resize(data_bases[i]);
+			data.insert(data.end(), obj.data.begin(), obj.data.end());
+		}
+	}
+	if(!ok) {
+		return EXIT_FAILURE;
+	}
+
+	if(!write_bytecode(out_path, image.data(), image.size(), data)) {
+		std::cerr << "ERROR: cannot write `" << out_path << "`" << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
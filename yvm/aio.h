@@ -0,0 +1,594 @@
+#ifndef __YVM_AIO_H__
+
+#define __YVM_AIO_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "yvm.h"
+
+// Asynchronous file I/O syscalls. A request is submitted and returns a
+// ticket right away, the program keeps running and collects the result
+// with io_wait. Requests go to io_uring when the kernel has it, to a
+// small thread pool otherwise, and are done synchronously on Windows.
+//
+// arguments are pushed in order and consumed, results are left in v1
+//   io_open  (4)  [path_addr path_len flags] -> ticket, flags: 0 read, 1 write, 2 append
+//   io_read  (5)  [fd addr len]              -> ticket
+//   io_write (6)  [fd addr len]              -> ticket
+//   io_wait  (7)  [ticket]                   -> bytes transferred, the fd for io_open, or -errno
+//   io_close (8)  [fd]                       -> 0 or -errno, synchronous
+// a negative ticket is an error from the submission itself.
+//
+// io_read and io_write accept the fds io_open returned and 0, 1, 2,
+// io_close only the former, anything else gives -EBADF. The host's own
+// descriptors, the io_uring ring among them, are out of reach.
+//
+// io_wait on an unfinished request blocks, harvesting every completion
+// that is ready. With `park` set it returns ERR_IO_PARKED instead and
+// leaves ip on the syscall, the host polls and resumes the VM later.
+
+#define YVM_SYSCALL_IO_OPEN 4
+#define YVM_SYSCALL_IO_READ 5
+#define YVM_SYSCALL_IO_WRITE 6
+#define YVM_SYSCALL_IO_WAIT 7
+#define YVM_SYSCALL_IO_CLOSE 8
+
+#define YVM_AIO_SLOTS 256
+#define YVM_AIO_PATH_MAX 256
+#define YVM_AIO_THREADS 4
+#define YVM_AIO_FDS 64
+
+typedef enum YvmAioState {
+	YVM_AIO_FREE,
+	YVM_AIO_PENDING,
+	YVM_AIO_DONE,
+} YvmAioState;
+
+typedef enum YvmAioOp {
+	YVM_AIO_OPEN,
+	YVM_AIO_READ,
+	YVM_AIO_WRITE,
+} YvmAioOp;
+
+typedef struct YvmAioSlot {
+	int state; // YvmAioState, written by the completing side
+	YvmAioOp op;
+	int fd;
+	uint8_t* buf;
+	int len;
+	int flags;
+	int result;
+	char path[YVM_AIO_PATH_MAX];
+} YvmAioSlot;
+
+typedef enum YvmAioBackend {
+	YVM_AIO_NONE, // not started, the first request picks a backend
+	YVM_AIO_URING,
+	YVM_AIO_POOL,
+	YVM_AIO_SYNC,
+} YvmAioBackend;
+
+#ifndef _WIN32
+
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+typedef struct __YvmUring {
+	int fd;
+	int error; // -errno once io_uring_enter failed for good, the ring is not used after
+	unsigned entries;
+	unsigned* sq_head;
+	unsigned* sq_tail;
+	unsigned* sq_mask;
+	unsigned* sq_array;
+	struct io_uring_sqe* sqes;
+	unsigned* cq_head;
+	unsigned* cq_tail;
+	unsigned* cq_mask;
+	struct io_uring_cqe* cqes;
+	void* sq_ptr;
+	size_t sq_size;
+	void* cq_ptr;
+	size_t cq_size;
+	size_t sqes_size;
+} __YvmUring;
+
+typedef struct __YvmPool {
+	pthread_t threads[YVM_AIO_THREADS];
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t done;
+	int queue[YVM_AIO_SLOTS];
+	int queue_head;
+	int queue_count;
+	bool stop;
+} __YvmPool;
+
+#endif
+
+typedef struct YvmAio {
+	YvmAioBackend backend;
+	bool park;
+	YvmAioSlot slots[YVM_AIO_SLOTS];
+	int fds[YVM_AIO_FDS]; // opened by io_open and not closed yet
+	int fd_count;
+#ifndef _WIN32
+	__YvmUring ring;
+	__YvmPool pool;
+#endif
+} YvmAio;
+
+void init_yvm_aio(YvmAio* aio, bool park) {
+	memset(aio, 0, sizeof(YvmAio));
+	aio->backend = YVM_AIO_NONE;
+	aio->park = park;
+}
+
+static inline int __aio_open_flags(int flags) {
+	if(flags == 1) return O_WRONLY | O_CREAT | O_TRUNC;
+	if(flags == 2) return O_WRONLY | O_CREAT | O_APPEND;
+	return O_RDONLY;
+}
+
+// performs a request on the calling thread, used by the pool and the
+// synchronous fallback
+int __aio_perform(YvmAioSlot* slot) {
+	int r = -1;
+	if(slot->op == YVM_AIO_OPEN) r = open(slot->path, __aio_open_flags(slot->flags), 0644);
+	else if(slot->op == YVM_AIO_READ) r = (int)read(slot->fd, slot->buf, slot->len);
+	else if(slot->op == YVM_AIO_WRITE) r = (int)write(slot->fd, slot->buf, slot->len);
+	return r < 0 ? -errno : r;
+}
+
+static inline void __aio_complete(YvmAioSlot* slot, int result) {
+	slot->result = result;
+	__atomic_store_n(&slot->state, YVM_AIO_DONE, __ATOMIC_RELEASE);
+}
+
+// index of `fd` in the open set, -1 when io_open did not return it
+int __aio_fd_find(const YvmAio* aio, int fd) {
+	for(int i = 0;i < aio->fd_count;++i) {
+		if(aio->fds[i] == fd) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+#ifndef _WIN32
+
+bool __uring_init(__YvmUring* r, unsigned entries) {
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	int fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+	if(fd < 0) {
+		return false;
+	}
+	// IORING_OP_READ, WRITE and OPENAT came with 5.6, FAST_POLL with 5.7
+	if((p.features & IORING_FEAT_FAST_POLL) == 0) {
+		close(fd);
+		return false;
+	}
+	r->fd = fd;
+	r->entries = p.sq_entries;
+	r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if(single) {
+		if(r->cq_size > r->sq_size) r->sq_size = r->cq_size;
+		r->cq_size = r->sq_size;
+	}
+	r->sq_ptr = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	r->cq_ptr = single ? r->sq_ptr
+		: mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+	r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if(r->sq_ptr == MAP_FAILED || r->cq_ptr == MAP_FAILED || r->sqes == MAP_FAILED) {
+		close(fd);
+		return false;
+	}
+	uint8_t* sq = r->sq_ptr;
+	uint8_t* cq = r->cq_ptr;
+	r->sq_head = (unsigned*)(sq + p.sq_off.head);
+	r->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+	r->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+	r->sq_array = (unsigned*)(sq + p.sq_off.array);
+	r->cq_head = (unsigned*)(cq + p.cq_off.head);
+	r->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+	r->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+	return true;
+}
+
+// io_uring_enter, -errno on failure. EINTR is retried
+int __uring_enter(__YvmUring* r, unsigned submit, unsigned complete, unsigned flags) {
+	for(;;) {
+		int n = (int)syscall(__NR_io_uring_enter, r->fd, submit, complete, flags, NULL, 0);
+		if(n >= 0 || errno != EINTR) {
+			return n >= 0 ? n : -errno;
+		}
+	}
+}
+
+void __uring_destroy(__YvmUring* r) {
+	munmap(r->sqes, r->sqes_size);
+	if(r->cq_ptr != r->sq_ptr) {
+		munmap(r->cq_ptr, r->cq_size);
+	}
+	munmap(r->sq_ptr, r->sq_size);
+	close(r->fd);
+}
+
+// every slot fits in the ring, so the queue can never be full.
+// returns 0 or the -errno the submission failed with, the entry is
+// taken back then so a later io_uring_enter cannot pick it up
+int __uring_submit(__YvmUring* r, YvmAioSlot* slot, int index) {
+	if(r->error != 0) {
+		return r->error;
+	}
+	unsigned tail = *r->sq_tail;
+	unsigned i = tail & *r->sq_mask;
+	struct io_uring_sqe* sqe = &r->sqes[i];
+	memset(sqe, 0, sizeof(*sqe));
+	if(slot->op == YVM_AIO_OPEN) {
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (uint64_t)(uintptr_t)slot->path;
+		sqe->len = 0644;
+		sqe->open_flags = __aio_open_flags(slot->flags);
+	} else {
+		sqe->opcode = slot->op == YVM_AIO_READ ? IORING_OP_READ : IORING_OP_WRITE;
+		sqe->fd = slot->fd;
+		sqe->addr = (uint64_t)(uintptr_t)slot->buf;
+		sqe->len = (unsigned)slot->len;
+		sqe->off = (uint64_t)-1; // current file position
+	}
+	sqe->user_data = (uint64_t)index;
+	r->sq_array[i] = i;
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	int n = __uring_enter(r, 1, 0, 0);
+	if(n == 1) {
+		return 0;
+	}
+	__atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE);
+	return n < 0 ? n : -EAGAIN;
+}
+
+// moves every available completion into its slot. when the wait fails
+// with anything but a busy ring nothing would ever complete, so every
+// pending slot is completed with that error and the ring is retired
+int __uring_reap(YvmAio* aio, bool wait) {
+	__YvmUring* r = &aio->ring;
+	if(r->error != 0) {
+		return 0;
+	}
+	if(wait) {
+		int n = __uring_enter(r, 0, 1, IORING_ENTER_GETEVENTS);
+		if(n < 0 && n != -EAGAIN && n != -EBUSY) {
+			r->error = n;
+			for(int i = 0;i < YVM_AIO_SLOTS;++i) {
+				if(__atomic_load_n(&aio->slots[i].state, __ATOMIC_ACQUIRE) == YVM_AIO_PENDING) {
+					__aio_complete(&aio->slots[i], n);
+				}
+			}
+			return 0;
+		}
+	}
+	unsigned head = *r->cq_head;
+	unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+	int reaped = 0;
+	for(;head != tail;++head) {
+		struct io_uring_cqe* cqe = &r->cqes[head & *r->cq_mask];
+		__aio_complete(&aio->slots[cqe->user_data], cqe->res);
+		reaped += 1;
+	}
+	__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+	return reaped;
+}
+
+void* __pool_worker(void* arg) {
+	YvmAio* aio = arg;
+	__YvmPool* pool = &aio->pool;
+	pthread_mutex_lock(&pool->lock);
+	for(;;) {
+		while(pool->queue_count == 0 && !pool->stop) {
+			pthread_cond_wait(&pool->work, &pool->lock);
+		}
+		if(pool->queue_count == 0) {
+			break;
+		}
+		int index = pool->queue[pool->queue_head];
+		pool->queue_head = (pool->queue_head + 1) % YVM_AIO_SLOTS;
+		pool->queue_count -= 1;
+		pthread_mutex_unlock(&pool->lock);
+		int result = __aio_perform(&aio->slots[index]);
+		pthread_mutex_lock(&pool->lock);
+		__aio_complete(&aio->slots[index], result);
+		pthread_cond_broadcast(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+bool __pool_init(YvmAio* aio) {
+	__YvmPool* pool = &aio->pool;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	for(int i = 0;i < YVM_AIO_THREADS;++i) {
+		if(pthread_create(&pool->threads[i], NULL, __pool_worker, aio) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void __pool_destroy(YvmAio* aio) {
+	__YvmPool* pool = &aio->pool;
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+	for(int i = 0;i < YVM_AIO_THREADS;++i) {
+		pthread_join(pool->threads[i], NULL);
+	}
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->work);
+	pthread_mutex_destroy(&pool->lock);
+}
+
+void __pool_submit(YvmAio* aio, int index) {
+	__YvmPool* pool = &aio->pool;
+	pthread_mutex_lock(&pool->lock);
+	pool->queue[(pool->queue_head + pool->queue_count) % YVM_AIO_SLOTS] = index;
+	pool->queue_count += 1;
+	pthread_cond_signal(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void __pool_wait(YvmAio* aio, int index) {
+	__YvmPool* pool = &aio->pool;
+	pthread_mutex_lock(&pool->lock);
+	while(__atomic_load_n(&aio->slots[index].state, __ATOMIC_ACQUIRE) != YVM_AIO_DONE) {
+		pthread_cond_wait(&pool->done, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void __aio_start(YvmAio* aio) {
+	if(getenv("YVM_AIO_NO_URING") == NULL && __uring_init(&aio->ring, YVM_AIO_SLOTS)) {
+		aio->backend = YVM_AIO_URING;
+	} else if(__pool_init(aio)) {
+		aio->backend = YVM_AIO_POOL;
+	} else {
+		aio->backend = YVM_AIO_SYNC;
+	}
+}
+
+#else
+
+void __aio_start(YvmAio* aio) {
+	aio->backend = YVM_AIO_SYNC;
+}
+
+#endif
+
+// collects finished requests. with a ticket it blocks until some
+// request completes (io_uring) or that one does (pool), -1 only collects.
+// a host running parked VMs calls this and resumes the VMs whose
+// tickets are done
+void yvm_aio_poll(YvmAio* aio, int ticket) {
+#ifndef _WIN32
+	if(aio->backend == YVM_AIO_URING) {
+		__uring_reap(aio, ticket >= 0);
+	} else if(aio->backend == YVM_AIO_POOL && ticket >= 0) {
+		__pool_wait(aio, ticket);
+	}
+#else
+	(void)aio;
+	(void)ticket;
+#endif
+}
+
+bool yvm_aio_done(YvmAio* aio, int ticket) {
+	return ticket >= 0 && ticket < YVM_AIO_SLOTS
+		&& __atomic_load_n(&aio->slots[ticket].state, __ATOMIC_ACQUIRE) == YVM_AIO_DONE;
+}
+
+// true when no request is in flight or uncollected and no io_open fd is
+// open, so nothing outside VM memory belongs to the program
+bool yvm_aio_idle(const YvmAio* aio) {
+	for(int i = 0;i < YVM_AIO_SLOTS;++i) {
+		if(__atomic_load_n(&aio->slots[i].state, __ATOMIC_ACQUIRE) != YVM_AIO_FREE) {
+			return false;
+		}
+	}
+	return aio->fd_count == 0;
+}
+
+// waits for everything still in flight, the buffers belong to VM
+// memory, and closes the fds the program left open
+void destroy_yvm_aio(YvmAio* aio) {
+	for(int i = 0;i < YVM_AIO_SLOTS;++i) {
+		while(__atomic_load_n(&aio->slots[i].state, __ATOMIC_ACQUIRE) == YVM_AIO_PENDING) {
+			yvm_aio_poll(aio, i);
+		}
+	}
+#ifndef _WIN32
+	if(aio->backend == YVM_AIO_URING) {
+		__uring_destroy(&aio->ring);
+	} else if(aio->backend == YVM_AIO_POOL) {
+		__pool_destroy(aio);
+	}
+#endif
+	for(int i = 0;i < aio->fd_count;++i) {
+		close(aio->fds[i]);
+	}
+	aio->fd_count = 0;
+	aio->backend = YVM_AIO_NONE;
+}
+
+// claims a slot for a request, returns its ticket or -errno
+int __aio_claim(YvmAio* aio) {
+	if(aio->backend == YVM_AIO_NONE) {
+		__aio_start(aio);
+	}
+	for(int i = 0;i < YVM_AIO_SLOTS;++i) {
+		if(aio->slots[i].state == YVM_AIO_FREE) {
+			aio->slots[i].state = YVM_AIO_PENDING;
+			return i;
+		}
+	}
+	return -EAGAIN;
+}
+
+void __aio_submit(YvmAio* aio, int index) {
+	YvmAioSlot* slot = &aio->slots[index];
+#ifndef _WIN32
+	if(aio->backend == YVM_AIO_URING) {
+		int e = __uring_submit(&aio->ring, slot, index);
+		if(e != 0) {
+			__aio_complete(slot, e);
+		}
+		return;
+	}
+	if(aio->backend == YVM_AIO_POOL) {
+		__pool_submit(aio, index);
+		return;
+	}
+#endif
+	__aio_complete(slot, __aio_perform(slot));
+}
+
+Err __host_io_open(YulaVM* yvm, void* ctx) {
+	YvmAio* aio = ctx;
+	int* flags = yvm_arg(yvm, 0);
+	int* len = yvm_arg(yvm, 1);
+	int* addr = yvm_arg(yvm, 2);
+	if(addr == NULL) {
+		return ERR_STACK_UNDERFLOW;
+	}
+	const uint8_t* path = yvm_mem_ptr(yvm, *addr, *len, false);
+	if(path == NULL || *len >= YVM_AIO_PATH_MAX) {
+		yvm->v1 = -EFAULT;
+		return yvm_drop(yvm, 3);
+	}
+	int ticket = __aio_claim(aio);
+	if(ticket >= 0) {
+		YvmAioSlot* slot = &aio->slots[ticket];
+		slot->op = YVM_AIO_OPEN;
+		slot->flags = *flags;
+		memcpy(slot->path, path, *len);
+		slot->path[*len] = '\0';
+		__aio_submit(aio, ticket);
+	}
+	yvm->v1 = ticket;
+	return yvm_drop(yvm, 3);
+}
+
+Err __host_io_transfer(YulaVM* yvm, YvmAio* aio, YvmAioOp op) {
+	int* len = yvm_arg(yvm, 0);
+	int* addr = yvm_arg(yvm, 1);
+	int* fd = yvm_arg(yvm, 2);
+	if(fd == NULL) {
+		return ERR_STACK_UNDERFLOW;
+	}
+	if((*fd < 0 || *fd > 2) && __aio_fd_find(aio, *fd) < 0) {
+		yvm->v1 = -EBADF;
+		return yvm_drop(yvm, 3);
+	}
+	// buffers may live in a mapping, reads need it to be writable
+	uint8_t* buf = yvm_mem_ptr(yvm, *addr, *len, op == YVM_AIO_READ);
+	if(buf == NULL) {
+		yvm->v1 = -EFAULT;
+		return yvm_drop(yvm, 3);
+	}
+	int ticket = __aio_claim(aio);
+	if(ticket >= 0) {
+		YvmAioSlot* slot = &aio->slots[ticket];
+		slot->op = op;
+		slot->fd = *fd;
+		slot->buf = buf;
+		slot->len = *len;
+		__aio_submit(aio, ticket);
+	}
+	yvm->v1 = ticket;
+	return yvm_drop(yvm, 3);
+}
+
+Err __host_io_read(YulaVM* yvm, void* ctx) {
+	return __host_io_transfer(yvm, ctx, YVM_AIO_READ);
+}
+
+Err __host_io_write(YulaVM* yvm, void* ctx) {
+	return __host_io_transfer(yvm, ctx, YVM_AIO_WRITE);
+}
+
+Err __host_io_wait(YulaVM* yvm, void* ctx) {
+	YvmAio* aio = ctx;
+	int* ticket = yvm_arg(yvm, 0);
+	if(ticket == NULL) {
+		return ERR_STACK_UNDERFLOW;
+	}
+	if(*ticket < 0 || *ticket >= YVM_AIO_SLOTS || aio->slots[*ticket].state == YVM_AIO_FREE) {
+		yvm->v1 = -EINVAL;
+		return yvm_drop(yvm, 1);
+	}
+	YvmAioSlot* slot = &aio->slots[*ticket];
+	if(!yvm_aio_done(aio, *ticket)) {
+		yvm_aio_poll(aio, -1);
+	}
+	while(!yvm_aio_done(aio, *ticket)) {
+		if(aio->park) {
+			// run the syscall again on resume
+			yvm->ip -= 1;
+			return ERR_IO_PARKED;
+		}
+		yvm_aio_poll(aio, *ticket);
+	}
+	yvm->v1 = slot->result;
+	if(slot->op == YVM_AIO_OPEN && slot->result >= 0) {
+		if(aio->fd_count == YVM_AIO_FDS) {
+			close(slot->result);
+			yvm->v1 = -EMFILE;
+		} else {
+			aio->fds[aio->fd_count++] = slot->result;
+		}
+	}
+	slot->state = YVM_AIO_FREE;
+	return yvm_drop(yvm, 1);
+}
+
+Err __host_io_close(YulaVM* yvm, void* ctx) {
+	YvmAio* aio = ctx;
+	int* fd = yvm_arg(yvm, 0);
+	if(fd == NULL) {
+		return ERR_STACK_UNDERFLOW;
+	}
+	int i = __aio_fd_find(aio, *fd);
+	if(i < 0) {
+		yvm->v1 = -EBADF;
+		return yvm_drop(yvm, 1);
+	}
+	aio->fds[i] = aio->fds[--aio->fd_count];
+	yvm->v1 = close(*fd) == 0 ? 0 : -errno;
+	return yvm_drop(yvm, 1);
+}
+
+void yvm_aio_install(YvmHostTable* table, YvmAio* aio) {
+	yvm_host_register(table, YVM_SYSCALL_IO_OPEN, "io_open", __host_io_open, aio);
+	yvm_host_register(table, YVM_SYSCALL_IO_READ, "io_read", __host_io_read, aio);
+	yvm_host_register(table, YVM_SYSCALL_IO_WRITE, "io_write", __host_io_write, aio);
+	yvm_host_register(table, YVM_SYSCALL_IO_WAIT, "io_wait", __host_io_wait, aio);
+	yvm_host_register(table, YVM_SYSCALL_IO_CLOSE, "io_close", __host_io_close, aio);
+}
+
+#endif // __YVM_AIO_H__
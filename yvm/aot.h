@@ -0,0 +1,102 @@
+#ifndef __YVM_AOT_H__
+
+#define __YVM_AOT_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "yvm.h"
+#include "aio.h"
+#include "filemap.h"
+
+// Runtime of the C programs written by yvm2c. The translated code keeps
+// sp, v0 and v1 in locals and only stores them back into the YulaVM
+// around syscalls, so the host functions, the memory layout and the
+// error signals are those of the interpreter. sjmp to an address the
+// translator did not see pushed continues in the interpreter.
+
+typedef Err (*YvmAotFn)(YulaVM* yvm);
+
+// the translated code is a single function with these locals:
+// mem, sp, bp, v0, v1, ip and e, and the labels fail and dispatch
+#define YVM_AOT_FAIL(err, at) do { e = (err); ip = (at); goto fail; } while(0)
+#define YVM_AOT_PUSH(value, at) do { \
+		if(sp >= YVM_MEM_CAPACITY) YVM_AOT_FAIL(ERR_STACK_OVERFLOW, at); \
+		int __v = (value); memcpy(mem + sp, &__v, 4); sp += 4; \
+	} while(0)
+// binary operations push into a slot they just popped
+#define YVM_AOT_PUT(value) do { int __v = (value); memcpy(mem + sp, &__v, 4); sp += 4; } while(0)
+#define YVM_AOT_POP(to, at) do { \
+		if(bp > sp) YVM_AOT_FAIL(ERR_STACK_UNDERFLOW, at); \
+		sp -= 4; memcpy(&(to), mem + sp, 4); \
+	} while(0)
+#define YVM_AOT_SYNC() do { yvm->stack_head = sp; yvm->v0 = v0; yvm->v1 = v1; } while(0)
+#define YVM_AOT_RELOAD() do { mem = yvm->memory; sp = yvm->stack_head; v0 = yvm->v0; v1 = yvm->v1; } while(0)
+
+// arithmetic wraps like the interpreter's does in practice, without
+// giving the C compiler signed overflow to optimize around
+static inline int yvm_aot_add(int a, int b) { return (int)((uint32_t)a + (uint32_t)b); }
+static inline int yvm_aot_sub(int a, int b) { return (int)((uint32_t)a - (uint32_t)b); }
+static inline int yvm_aot_mul(int a, int b) { return (int)((uint32_t)a * (uint32_t)b); }
+
+static inline const uint8_t* yvm_aot_src(YulaVM* yvm, uint8_t* mem, int addr) {
+	if(addr >= 0 && addr <= YVM_MEM_CAPACITY - 4) {
+		return mem + addr;
+	}
+	return yvm_mem_ptr(yvm, addr, 4, false);
+}
+
+static inline uint8_t* yvm_aot_dst(YulaVM* yvm, uint8_t* mem, int addr) {
+	if(addr >= 0 && addr <= YVM_MEM_CAPACITY - 4) {
+		return mem + addr;
+	}
+	return yvm_mem_ptr(yvm, addr, 4, true);
+}
+
+// continues from yvm->ip in the interpreter
+Err yvm_aot_interpret(YulaVM* yvm) {
+	for(;yvm->ip < yvm->code_size;) {
+		Err e = yvm_exec_instr(yvm);
+		if(e != ERR_OK) {
+			return e;
+		}
+	}
+	return ERR_OK;
+}
+
+// the main of a translated program: the services of `yvm` with the
+// code loaded for the interpreter fallback and the data in memory
+int yvm_aot_main(const Instr* code, size_t count, const uint8_t* data, int data_addr, int data_size, YvmAotFn run) {
+	YulaVM* _Yvm = malloc(sizeof(YulaVM));
+	init_yvm(_Yvm, YVM_MEM_CAPACITY);
+
+	YvmHostTable host;
+	yvm_host_init(&host);
+	YvmAio* aio = malloc(sizeof(YvmAio));
+	init_yvm_aio(aio, false);
+	yvm_aio_install(&host, aio);
+	yvm_filemap_install(&host, aio);
+	_Yvm->host = &host;
+	yvm_load_bytecode(_Yvm, code, count, "YM");
+	yvm_program_data(_Yvm->program, data_addr, data, data_size);
+	yvm_init_data(_Yvm);
+
+	Err e = run(_Yvm);
+	if(e != ERR_OK) {
+		fflush(stdout);
+		fprintf(stderr, "SIGNAL: %s\n", err_as_cstr(e));
+		err_destroy_yvm(_Yvm);
+	}
+
+	int exit_code = _Yvm->exit_code;
+	destroy_yvm_aio(aio);
+	free(aio);
+	yvm_release_mappings(_Yvm);
+	yvm_detach_program(_Yvm);
+	free(_Yvm->memory);
+	free(_Yvm);
+	return exit_code;
+}
+
+#endif // __YVM_AOT_H__
@@ -0,0 +1,305 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "yvm.h"
+#include "budget.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#define YVM_NULL_DEVICE "/dev/null"
+#else
+#include <windows.h>
+#include <psapi.h>
+#define YVM_NULL_DEVICE "NUL"
+#endif
+
+// yvm-bench: runs bytecode workloads (see bench/) with warmup and
+// reports instructions per second, ns per instruction, load time and
+// peak RSS, as a table on stderr and JSON on stdout or in a file.
+// program output is discarded while measuring.
+
+typedef struct BenchResult {
+	const char* name;
+	uint64_t instructions;
+	uint64_t load_ns;
+	uint64_t median_ns;
+	uint64_t min_ns;
+	uint64_t mean_ns;
+} BenchResult;
+
+void usage(FILE* stream) {
+	fputs("Incorrect usage... Correct is:\n", stream);
+	fputs("yvm-bench [flags] <workload.bin>...\n", stream);
+	fputs("    --runs <n>       measured runs per workload (default 10)\n", stream);
+	fputs("    --warmup <n>     unmeasured runs first (default 2)\n", stream);
+	fputs("    --json <file>    write the JSON report to a file instead of stdout\n", stream);
+	fputs("    --samples <file> append every measured run to a file for yperf\n", stream);
+}
+
+// the high-water mark of the whole process, it never goes down so it
+// is reported once for the run rather than per workload
+long peak_rss_kb(void) {
+#ifndef _WIN32
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+#else
+	PROCESS_MEMORY_COUNTERS counters;
+	K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+	return (long)(counters.PeakWorkingSetSize / 1024);
+#endif
+}
+
+uint8_t* read_image(const char* path, size_t* size) {
+	FILE* file = fopen(path, "rb");
+	if(file == NULL) {
+		return NULL;
+	}
+	fseek(file, 0L, SEEK_END);
+	long end = ftell(file);
+	fseek(file, 0L, SEEK_SET);
+	uint8_t* image = malloc(end > 0 ? end : 1);
+	*size = fread(image, 1, end > 0 ? end : 0, file);
+	fclose(file);
+	return image;
+}
+
+int cmp_u64(const void* a, const void* b) {
+	uint64_t x = *(const uint64_t*)a;
+	uint64_t y = *(const uint64_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+// the name of a workload is its file name without directory and extension
+const char* workload_name(const char* path, char* out, size_t size) {
+	const char* base = path;
+	for(const char* c = path;*c != '\0';++c) {
+		if(*c == '/' || *c == '\\') base = c + 1;
+	}
+	snprintf(out, size, "%s", base);
+	char* dot = strrchr(out, '.');
+	if(dot != NULL) *dot = '\0';
+	return out;
+}
+
+// one fresh VM per run, as a user of yvm would get it
+uint64_t run_once(const uint8_t* image, size_t size, uint64_t* load_ns) {
+	YulaVM* yvm = malloc(sizeof(YulaVM));
+	init_yvm(yvm, YVM_MEM_CAPACITY);
+	uint64_t start = yvm_now_ns();
+	yvm_load_image(yvm, image, size, false);
+	uint64_t loaded = yvm_now_ns();
+	yvm_exec_prog(yvm);
+	uint64_t end = yvm_now_ns();
+	yvm_detach_program(yvm);
+	free(yvm->memory);
+	free(yvm);
+	*load_ns = loaded - start;
+	return end - loaded;
+}
+
+// the dispatch count comes from one budgeted run, timing uses the plain loop
+uint64_t count_instructions(const uint8_t* image, size_t size) {
+	YulaVM* yvm = malloc(sizeof(YulaVM));
+	init_yvm(yvm, YVM_MEM_CAPACITY);
+	yvm_load_image(yvm, image, size, false);
+	YvmBudget budget;
+	init_yvm_budget(&budget, 0, 0);
+	Err e = yvm_exec_budgeted(yvm, &budget);
+	yvm_detach_program(yvm);
+	free(yvm->memory);
+	free(yvm);
+	if(e != ERR_OK) {
+		fprintf(stderr, "SIGNAL: %s\n", err_as_cstr(e));
+		exit(1);
+	}
+	return budget.executed;
+}
+
+// a program filling the code capacity, measures load time alone
+uint8_t* large_image(size_t* size) {
+	*size = YVM_HEADER_SIZE + YVM_CODE_CAPACITY * sizeof(Instr);
+	uint8_t* image = calloc(*size, 1);
+	uint32_t count = YVM_CODE_CAPACITY;
+	image[0] = 'Y';
+	image[1] = 'M';
+	memcpy(image + 4, &count, 4);
+	Instr* code = (Instr*)(image + YVM_HEADER_SIZE);
+	for(int i = 0;i < YVM_CODE_CAPACITY;++i) {
+		code[i].type = (i % 2 == 0) ? INSTR_PUSH : INSTR_POP;
+		code[i].operand = i % 2 == 0 ? i : REG_V0;
+	}
+	return image;
+}
+
+// one line per measured run: tool workload metric ns
+void write_sample(FILE* out, const char* name, const char* metric, uint64_t ns) {
+	fprintf(out, "yvm %s %s %llu\n", name, metric, (unsigned long long)ns);
+}
+
+void write_json(FILE* out, const BenchResult* results, int count, int runs, int warmup, long rss_kb) {
+	fprintf(out, "{\n");
+	fprintf(out, "  \"runs\": %d,\n", runs);
+	fprintf(out, "  \"warmup\": %d,\n", warmup);
+	fprintf(out, "  \"peak_rss_kb\": %ld,\n", rss_kb);
+	fprintf(out, "  \"workloads\": [\n");
+	for(int i = 0;i < count;++i) {
+		const BenchResult* r = &results[i];
+		double ns_per_instr = r->instructions > 0 ? (double)r->median_ns / (double)r->instructions : 0.0;
+		double per_second = r->median_ns > 0 ? (double)r->instructions * 1e9 / (double)r->median_ns : 0.0;
+		fprintf(out, "    {\n");
+		fprintf(out, "      \"name\": \"%s\",\n", r->name);
+		fprintf(out, "      \"instructions\": %llu,\n", (unsigned long long)r->instructions);
+		fprintf(out, "      \"load_ns\": %llu,\n", (unsigned long long)r->load_ns);
+		fprintf(out, "      \"median_ns\": %llu,\n", (unsigned long long)r->median_ns);
+		fprintf(out, "      \"min_ns\": %llu,\n", (unsigned long long)r->min_ns);
+		fprintf(out, "      \"mean_ns\": %llu,\n", (unsigned long long)r->mean_ns);
+		fprintf(out, "      \"ns_per_instruction\": %.4f,\n", ns_per_instr);
+		fprintf(out, "      \"instructions_per_second\": %.0f\n", per_second);
+		fprintf(out, "    }%s\n", i + 1 < count ? "," : "");
+	}
+	fprintf(out, "  ]\n");
+	fprintf(out, "}\n");
+}
+
+int main(int argc, const char* argv[]) {
+	int runs = 10;
+	int warmup = 2;
+	const char* json_path = NULL;
+	const char* samples_path = NULL;
+	const char* paths[256];
+	int path_count = 0;
+	for(int i = 1;i < argc;++i) {
+		if(strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+			runs = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+			warmup = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+			json_path = argv[++i];
+		}
+		else if(strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+			samples_path = argv[++i];
+		}
+		else if(path_count < 256) {
+			paths[path_count++] = argv[i];
+		}
+	}
+	if(path_count == 0 || runs < 1 || warmup < 0) {
+		usage(stderr);
+		exit(1);
+	}
+
+	// one slot per workload plus the load-only program
+	BenchResult* results = calloc(path_count + 1, sizeof(BenchResult));
+	char (*names)[64] = calloc(path_count, sizeof(*names));
+	uint64_t* samples = malloc(sizeof(uint64_t) * runs);
+	uint64_t* loads = malloc(sizeof(uint64_t) * runs);
+	FILE* samples_file = NULL;
+	if(samples_path != NULL && (samples_file = fopen(samples_path, "a")) == NULL) {
+		fprintf(stderr, "ERROR: cannot write `%s`\n", samples_path);
+		exit(1);
+	}
+
+	fflush(stdout);
+	int saved_stdout = dup(1);
+	int null_fd = open(YVM_NULL_DEVICE, O_WRONLY);
+
+	for(int w = 0;w <= path_count;++w) {
+		size_t size = 0;
+		uint8_t* image;
+		BenchResult* r = &results[w];
+		if(w < path_count) {
+			image = read_image(paths[w], &size);
+			if(image == NULL) {
+				fprintf(stderr, "ERROR: cannot read `%s`\n", paths[w]);
+				exit(1);
+			}
+			r->name = workload_name(paths[w], names[w], sizeof(names[w]));
+		} else {
+			image = large_image(&size);
+			r->name = "load";
+		}
+		fflush(stdout);
+		dup2(null_fd, 1);
+		r->instructions = w < path_count ? count_instructions(image, size) : 0;
+		uint64_t load_ns;
+		for(int i = 0;i < warmup;++i) {
+			if(w < path_count) run_once(image, size, &load_ns);
+		}
+		for(int i = 0;i < runs;++i) {
+			if(w < path_count) {
+				samples[i] = run_once(image, size, &loads[i]);
+			} else {
+				// only load, executing this program would underflow
+				YulaVM* yvm = malloc(sizeof(YulaVM));
+				init_yvm(yvm, YVM_MEM_CAPACITY);
+				uint64_t start = yvm_now_ns();
+				yvm_load_image(yvm, image, size, false);
+				loads[i] = yvm_now_ns() - start;
+				samples[i] = 0;
+				yvm_detach_program(yvm);
+				free(yvm->memory);
+				free(yvm);
+			}
+		}
+		fflush(stdout);
+		dup2(saved_stdout, 1);
+
+		uint64_t total = 0;
+		for(int i = 0;i < runs;++i) {
+			total += samples[i];
+			if(samples_file != NULL) {
+				if(w < path_count) write_sample(samples_file, r->name, "run", samples[i]);
+				write_sample(samples_file, r->name, "load", loads[i]);
+			}
+		}
+		qsort(samples, runs, sizeof(uint64_t), cmp_u64);
+		qsort(loads, runs, sizeof(uint64_t), cmp_u64);
+		r->median_ns = samples[runs / 2];
+		r->min_ns = samples[0];
+		r->mean_ns = total / runs;
+		r->load_ns = loads[runs / 2];
+		free(image);
+
+		if(w < path_count) {
+			fprintf(stderr, "%-12s %12llu instr  %10.3f ms  %8.3f ns/instr  %8.1f Minstr/s  load %6llu ns\n", r->name,
+				(unsigned long long)r->instructions, (double)r->median_ns / 1e6,
+				(double)r->median_ns / (double)(r->instructions > 0 ? r->instructions : 1),
+				(double)r->instructions * 1e3 / (double)(r->median_ns > 0 ? r->median_ns : 1),
+				(unsigned long long)r->load_ns);
+		} else {
+			fprintf(stderr, "%-12s %12d code   load %6llu ns\n", r->name, YVM_CODE_CAPACITY, (unsigned long long)r->load_ns);
+		}
+	}
+	close(null_fd);
+	close(saved_stdout);
+	if(samples_file != NULL) {
+		fclose(samples_file);
+	}
+
+	FILE* out = stdout;
+	if(json_path != NULL) {
+		out = fopen(json_path, "w");
+		if(out == NULL) {
+			fprintf(stderr, "ERROR: cannot write `%s`\n", json_path);
+			exit(1);
+		}
+	}
+	long rss_kb = peak_rss_kb();
+	fprintf(stderr, "peak rss %ld KB over all workloads\n", rss_kb);
+	write_json(out, results, path_count + 1, runs, warmup, rss_kb);
+	if(out != stdout) {
+		fclose(out);
+	}
+
+	free(loads);
+	free(samples);
+	free(names);
+	free(results);
+	return 0;
+}
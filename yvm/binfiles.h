@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 static int FILE_SIZE;
 
@@ -33,6 +34,30 @@ void read_bin_file(const char* path, char* buffer) {
 	fclose(file);
 }
 
+// reads the 8 byte header into tmp_buf/tmp_buf2 and `size` bytes after
+// it, false when the file cannot be opened or is shorter than that
+bool read_bin_file_n(const char* path, char* buffer, size_t size) {
+	FILE* file = fopen(path, "rb");
+	if(file == NULL) {
+		return false;
+	}
+	bool ok = fread(tmp_buf, sizeof(char), 2, file) == 2
+		&& fread(tmp_buf2, sizeof(char), 6, file) == 6
+		&& fread(buffer, sizeof(char), size, file) == size;
+	fclose(file);
+	return ok;
+}
+
+bool read_bin_header(const char* path, char* header) {
+	FILE* file = fopen(path, "rb");
+	if(file == NULL) {
+		return false;
+	}
+	size_t got = fread(header, sizeof(char), 8, file);
+	fclose(file);
+	return got == 8;
+}
+
 void write_bin_file(const char* path, char* buffer, int size) {
 	FILE* file = fopen(path, "wb");
 	fwrite(buffer, sizeof(char), size, file);
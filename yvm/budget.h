@@ -0,0 +1,86 @@
+#ifndef __YVM_BUDGET_H__
+
+#define __YVM_BUDGET_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "yvm.h"
+
+// Instruction budgets and deadlines for running untrusted programs in
+// slices. Straight line code is counted when it ends, the budget is only
+// checked after a backward jump or an sjmp, so every loop iteration and
+// every return passes a check while plain code pays one compare per
+// instruction. A slice can overrun its fuel by one straight line run.
+//
+// On ERR_OUT_OF_FUEL or ERR_DEADLINE the jump has completed and ip holds
+// its target, refilling the budget and calling yvm_exec_budgeted again
+// resumes the program where it stopped.
+
+#define YVM_FUEL_UNLIMITED INT64_MAX
+// backward jumps between two reads of the clock
+#define YVM_DEADLINE_CHECK_INTERVAL 1024
+
+typedef struct YvmBudget {
+	int64_t fuel;      // instructions left, refilled by the caller
+	uint64_t deadline; // yvm_now_ns() value to stop at, 0 for none
+	uint64_t executed; // instructions run over all slices
+	int until_clock;
+} YvmBudget;
+
+static inline uint64_t yvm_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void init_yvm_budget(YvmBudget* budget, int64_t fuel, uint64_t timeout_ns) {
+	budget->fuel = fuel > 0 ? fuel : YVM_FUEL_UNLIMITED;
+	budget->deadline = timeout_ns > 0 ? yvm_now_ns() + timeout_ns : 0;
+	budget->executed = 0;
+	budget->until_clock = 0;
+}
+
+static inline void __budget_charge(YvmBudget* budget, int64_t count) {
+	budget->fuel -= count;
+	budget->executed += (uint64_t)count;
+}
+
+Err yvm_exec_budgeted(YulaVM* yvm, YvmBudget* budget) {
+	int start = yvm->ip;
+	for(;yvm->ip < yvm->code_size;) {
+		int ip = yvm->ip;
+		Instr cur_inst = yvm->code[ip];
+		Err e = __yvm_dispatch(yvm, cur_inst);
+		if(e != ERR_OK) {
+			__budget_charge(budget, ip - start);
+			return e;
+		}
+		if(yvm->ip == ip + 1) {
+			continue;
+		}
+		__budget_charge(budget, ip - start + 1);
+		start = yvm->ip;
+		if(yvm->ip > ip && cur_inst.type != INSTR_JMP_ONSTACK) {
+			continue;
+		}
+		if(budget->fuel <= 0) {
+			return ERR_OUT_OF_FUEL;
+		}
+		if(budget->deadline != 0 && --budget->until_clock <= 0) {
+			budget->until_clock = YVM_DEADLINE_CHECK_INTERVAL;
+			if(yvm_now_ns() >= budget->deadline) {
+				return ERR_DEADLINE;
+			}
+		}
+	}
+	if(yvm->ip >= yvm->code_size && start < yvm->code_size) {
+		// the last run fell off the end of the code
+		__budget_charge(budget, yvm->code_size - start);
+	}
+	return ERR_OK;
+}
+
+#endif // __YVM_BUDGET_H__
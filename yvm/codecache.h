@@ -0,0 +1,253 @@
+#ifndef __YVM_CODECACHE_H__
+
+#define __YVM_CODECACHE_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include "yvm.h"
+#include "regir.h"
+
+// Cache of the register form next to the bytecode (<input>.yrc), so a
+// program is only translated on its first run. The file is keyed by a
+// hash of the code and the build id of the VM, anything else is
+// translated again and the cache rewritten. Later runs map the file and
+// run the ops from the mapping without copying them.
+//
+// file: "YR" u8 version u8 reserved u32 build_id u64 code_hash,
+// i32 code_size op_count const_count, u32 payload_hash, then the ops,
+// the literals and the block entries as in YvmRegProg.
+
+#define YVM_CODE_CACHE_VERSION 1
+#define YVM_CODE_CACHE_HEADER 32
+#define YVM_CODE_CACHE_EXT ".yrc"
+
+// changes with every build of the VM unless given one
+#ifndef YVM_BUILD_ID
+#define YVM_BUILD_ID __DATE__ " " __TIME__
+#endif
+
+typedef struct YvmCodeCache {
+	YvmRegProg prog;
+	void* mapping; // NULL when the program was translated here
+	size_t size;
+} YvmCodeCache;
+
+static uint64_t __codecache_hash(uint64_t hash, const void* data, size_t size) {
+	const uint8_t* bytes = data;
+	for(size_t i = 0;i < size;++i) {
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+uint32_t yvm_build_id(void) {
+	uint64_t hash = __codecache_hash(14695981039346656037ull, YVM_BUILD_ID, strlen(YVM_BUILD_ID));
+	int layout[3] = { (int)sizeof(YvmRegOp), YVM_REGIR_CONST_BASE, REGIR_END };
+	hash = __codecache_hash(hash, layout, sizeof(layout));
+	return (uint32_t)(hash ^ (hash >> 32));
+}
+
+uint64_t yvm_code_hash64(const Instr* code, int count) {
+	return __codecache_hash(14695981039346656037ull, code, (size_t)count * sizeof(Instr));
+}
+
+static size_t __codecache_size(int code_size, int op_count, int const_count) {
+	return YVM_CODE_CACHE_HEADER + (size_t)op_count * sizeof(YvmRegOp)
+		+ (size_t)const_count * sizeof(int) + (size_t)(code_size + 1) * sizeof(int);
+}
+
+static void __codecache_arrays(YvmRegProg* prog, uint8_t* data) {
+	uint8_t* at = data + YVM_CODE_CACHE_HEADER;
+	prog->ops = (YvmRegOp*)at;
+	at += (size_t)prog->op_count * sizeof(YvmRegOp);
+	prog->consts = (int*)at;
+	at += (size_t)prog->const_count * sizeof(int);
+	prog->entry = (int*)at;
+}
+
+static uint32_t __codecache_payload_hash(const uint8_t* data, size_t size) {
+	uint64_t hash = __codecache_hash(14695981039346656037ull, data + YVM_CODE_CACHE_HEADER, size - YVM_CODE_CACHE_HEADER);
+	return (uint32_t)(hash ^ (hash >> 32));
+}
+
+// the ops only index registers, ops, addresses and entries that exist,
+// so a damaged file cannot make the executor step outside its arrays
+static bool __codecache_check(const YvmRegProg* prog) {
+	int regs = YVM_REGIR_CONST_BASE + prog->const_count;
+	for(int i = 0;i < prog->op_count;++i) {
+		const YvmRegOp* op = &prog->ops[i];
+		if(op->kind > REGIR_END || op->dst >= regs || op->a >= regs || op->b >= regs
+			|| op->ip < 0 || op->ip > prog->code_size) {
+			return false;
+		}
+		if(op->kind == REGIR_JMP && (op->arg < 0 || op->arg >= prog->op_count)) {
+			return false;
+		}
+		if(op->kind == REGIR_JTAB && (op->arg < 0 || op->arg >= prog->code_size - op->ip - 1)) {
+			return false;
+		}
+		if(op->kind == REGIR_BLOCK && (op->arg < -YVM_REGIR_NO_CHECK || op->arg > YVM_REGIR_NO_CHECK
+			|| op->arg2 < -YVM_REGIR_NO_CHECK || op->arg2 > YVM_REGIR_NO_CHECK)) {
+			return false;
+		}
+	}
+	for(int ip = 0;ip <= prog->code_size;++ip) {
+		if(prog->entry[ip] < -1 || prog->entry[ip] >= prog->op_count) {
+			return false;
+		}
+	}
+	return prog->entry[prog->code_size] >= 0;
+}
+
+static bool __codecache_parse(YvmRegProg* prog, uint8_t* data, size_t size, const Instr* code, int count) {
+	if(size < YVM_CODE_CACHE_HEADER || data[0] != 'Y' || data[1] != 'R' || data[2] != YVM_CODE_CACHE_VERSION) {
+		return false;
+	}
+	uint32_t build_id;
+	uint64_t code_hash;
+	int32_t counts[3];
+	uint32_t payload_hash;
+	memcpy(&build_id, data + 4, 4);
+	memcpy(&code_hash, data + 8, 8);
+	memcpy(counts, data + 16, 12);
+	memcpy(&payload_hash, data + 28, 4);
+	if(build_id != yvm_build_id() || counts[0] != count || code_hash != yvm_code_hash64(code, count)
+		|| counts[1] <= 0 || counts[2] < 0 || size != __codecache_size(counts[0], counts[1], counts[2])
+		|| payload_hash != __codecache_payload_hash(data, size)) {
+		return false;
+	}
+	prog->code_size = counts[0];
+	prog->op_count = counts[1];
+	prog->const_count = counts[2];
+	__codecache_arrays(prog, data);
+	return __codecache_check(prog);
+}
+
+// written under a temporary name and renamed, so concurrent runs only
+// ever see whole files
+bool yvm_code_cache_write(const YvmRegProg* prog, const Instr* code, const char* path) {
+	size_t size = __codecache_size(prog->code_size, prog->op_count, prog->const_count);
+	uint8_t* data = calloc(size, 1);
+	data[0] = 'Y';
+	data[1] = 'R';
+	data[2] = YVM_CODE_CACHE_VERSION;
+	uint32_t build_id = yvm_build_id();
+	uint64_t code_hash = yvm_code_hash64(code, prog->code_size);
+	int32_t counts[3] = { prog->code_size, prog->op_count, prog->const_count };
+	memcpy(data + 4, &build_id, 4);
+	memcpy(data + 8, &code_hash, 8);
+	memcpy(data + 16, counts, 12);
+	YvmRegProg view = *prog;
+	__codecache_arrays(&view, data);
+	memcpy(view.ops, prog->ops, (size_t)prog->op_count * sizeof(YvmRegOp));
+	memcpy(view.consts, prog->consts, (size_t)prog->const_count * sizeof(int));
+	memcpy(view.entry, prog->entry, (size_t)(prog->code_size + 1) * sizeof(int));
+	uint32_t payload_hash = __codecache_payload_hash(data, size);
+	memcpy(data + 28, &payload_hash, 4);
+
+	char tmp[1024];
+	snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+	FILE* file = fopen(tmp, "wb");
+	bool ok = file != NULL;
+	if(ok) {
+		ok = fwrite(data, 1, size, file) == size;
+		ok = fclose(file) == 0 && ok;
+	}
+	free(data);
+	if(ok) {
+#ifdef _WIN32
+		remove(path); // rename does not replace files on Windows
+#endif
+		ok = rename(tmp, path) == 0;
+	}
+	if(!ok) {
+		remove(tmp);
+	}
+	return ok;
+}
+
+#ifndef _WIN32
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static void* __codecache_map(const char* path, size_t* size) {
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) {
+		return NULL;
+	}
+	struct stat st;
+	void* data = MAP_FAILED;
+	if(fstat(fd, &st) == 0 && st.st_size > 0) {
+		*size = (size_t)st.st_size;
+		data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	return data == MAP_FAILED ? NULL : data;
+}
+
+static void __codecache_unmap(void* data, size_t size) {
+	munmap(data, size);
+}
+
+#else
+
+// no mmap, the file is read instead
+static void* __codecache_map(const char* path, size_t* size) {
+	FILE* file = fopen(path, "rb");
+	if(file == NULL) {
+		return NULL;
+	}
+	fseek(file, 0, SEEK_END);
+	long end = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	void* data = end > 0 ? malloc((size_t)end) : NULL;
+	if(data != NULL && fread(data, 1, (size_t)end, file) != (size_t)end) {
+		free(data);
+		data = NULL;
+	}
+	fclose(file);
+	*size = (size_t)end;
+	return data;
+}
+
+static void __codecache_unmap(void* data, size_t size) {
+	(void)size;
+	free(data);
+}
+
+#endif
+
+// the register form of `code` from <input>.yrc, or translated and
+// written there when the file is missing, stale or damaged
+void yvm_code_cache_load(YvmCodeCache* cache, const char* input, const Instr* code, int count) {
+	char path[1024];
+	snprintf(path, sizeof(path), "%s" YVM_CODE_CACHE_EXT, input);
+	cache->mapping = __codecache_map(path, &cache->size);
+	if(cache->mapping != NULL) {
+		if(__codecache_parse(&cache->prog, cache->mapping, cache->size, code, count)) {
+			return;
+		}
+		__codecache_unmap(cache->mapping, cache->size);
+		cache->mapping = NULL;
+	}
+	yvm_regir_translate(&cache->prog, code, count);
+	// a directory we cannot write to only costs the next run a translation
+	yvm_code_cache_write(&cache->prog, code, path);
+}
+
+void yvm_code_cache_release(YvmCodeCache* cache) {
+	if(cache->mapping != NULL) {
+		__codecache_unmap(cache->mapping, cache->size);
+		cache->mapping = NULL;
+	} else {
+		destroy_yvm_regir(&cache->prog);
+	}
+}
+
+#endif // __YVM_CODECACHE_H__
@@ -0,0 +1,228 @@
+#ifndef __YVM_DEBUGINFO_H__
+
+#define __YVM_DEBUGINFO_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+// bytecode header: "YM" u8 flags u8 reserved u32 code_count
+// a code_count of 0 means a legacy file where everything after the
+// header is code. with YVM_HAS_DATA the data section follows the code,
+// its bytes are copied to memory[addr, addr+size) when the program loads:
+//   "YI" u32 addr u32 size, u8 bytes[size]
+// with YVM_HAS_DEBUG the debug section comes next:
+//   "YD" u32 string_count, strings: (u32 len, char[len])
+//   u32 line_count,  lines:  (u32 addr, u32 file, u32 line, u32 col)
+//   u32 label_count, labels: (u32 addr, u32 name)
+//   u32 call_count,  calls:  (u32 addr, u32 callee)
+// all tables are sorted by addr
+
+#define YVM_HEADER_SIZE 8
+#define YVM_HAS_DEBUG 1
+#define YVM_HAS_DATA 2
+#define YVM_DATA_HEADER 10
+
+typedef struct YvmLine {
+	uint32_t addr;
+	uint32_t file;
+	uint32_t line;
+	uint32_t col;
+} YvmLine;
+
+typedef struct YvmSym {
+	uint32_t addr;
+	uint32_t name;
+} YvmSym;
+
+typedef struct YvmDebugInfo {
+	char** strings;
+	uint32_t string_count;
+	YvmLine* lines;
+	uint32_t line_count;
+	YvmSym* labels;
+	uint32_t label_count;
+	YvmSym* calls;
+	uint32_t call_count;
+} YvmDebugInfo;
+
+typedef struct __DebugReader {
+	const uint8_t* data;
+	size_t size;
+	size_t pos;
+	bool ok;
+} __DebugReader;
+
+uint32_t __debug_u32(__DebugReader* r) {
+	uint32_t value = 0;
+	if(r->pos + 4 > r->size) {
+		r->ok = false;
+		return 0;
+	}
+	memcpy(&value, r->data + r->pos, 4);
+	r->pos += 4;
+	return value;
+}
+
+void __debug_table(__DebugReader* r, void** table, uint32_t* count, size_t entry_size) {
+	*count = __debug_u32(r);
+	*table = NULL;
+	if(!r->ok || (size_t)*count * entry_size > r->size - r->pos) {
+		r->ok = false;
+		*count = 0;
+		return;
+	}
+	*table = malloc((size_t)*count * entry_size + 1);
+	memcpy(*table, r->data + r->pos, (size_t)*count * entry_size);
+	r->pos += (size_t)*count * entry_size;
+}
+
+void yvm_free_debug_info(YvmDebugInfo* info) {
+	if(info == NULL) {
+		return;
+	}
+	for(uint32_t i = 0;i < info->string_count;++i) {
+		free(info->strings[i]);
+	}
+	free(info->strings);
+	free(info->lines);
+	free(info->labels);
+	free(info->calls);
+	free(info);
+}
+
+// parses the debug section, returns NULL if it is malformed
+YvmDebugInfo* yvm_parse_debug_info(const uint8_t* data, size_t size) {
+	__DebugReader r = { .data = data, .size = size, .pos = 0, .ok = size >= 2 && data[0] == 'Y' && data[1] == 'D' };
+	r.pos = 2;
+	YvmDebugInfo* info = calloc(1, sizeof(YvmDebugInfo));
+	uint32_t string_count = __debug_u32(&r);
+	if(r.ok && string_count <= size) {
+		info->strings = calloc(string_count + 1, sizeof(char*));
+		for(uint32_t i = 0;r.ok && i < string_count;++i) {
+			uint32_t len = __debug_u32(&r);
+			if(!r.ok || len > size - r.pos) {
+				r.ok = false;
+				break;
+			}
+			info->strings[i] = malloc(len + 1);
+			memcpy(info->strings[i], data + r.pos, len);
+			info->strings[i][len] = '\0';
+			r.pos += len;
+			info->string_count = i + 1;
+		}
+	} else {
+		r.ok = false;
+	}
+	if(r.ok) __debug_table(&r, (void**)&info->lines, &info->line_count, sizeof(YvmLine));
+	if(r.ok) __debug_table(&r, (void**)&info->labels, &info->label_count, sizeof(YvmSym));
+	if(r.ok) __debug_table(&r, (void**)&info->calls, &info->call_count, sizeof(YvmSym));
+	for(uint32_t i = 0;r.ok && i < info->line_count;++i) {
+		r.ok = info->lines[i].file < info->string_count;
+	}
+	for(uint32_t i = 0;r.ok && i < info->label_count;++i) {
+		r.ok = info->labels[i].name < info->string_count;
+	}
+	for(uint32_t i = 0;r.ok && i < info->call_count;++i) {
+		r.ok = info->calls[i].name < info->string_count;
+	}
+	if(!r.ok) {
+		yvm_free_debug_info(info);
+		return NULL;
+	}
+	return info;
+}
+
+// reads only the debug section of a bytecode file, called when debugging
+// or profiling is enabled so plain runs never touch it
+YvmDebugInfo* yvm_load_debug_info(const char* path) {
+	FILE* file = fopen(path, "rb");
+	if(file == NULL) {
+		return NULL;
+	}
+	uint8_t header[YVM_HEADER_SIZE];
+	if(fread(header, 1, YVM_HEADER_SIZE, file) != YVM_HEADER_SIZE || (header[2] & YVM_HAS_DEBUG) == 0) {
+		fclose(file);
+		return NULL;
+	}
+	uint32_t code_count;
+	memcpy(&code_count, header + 4, 4);
+	fseek(file, 0L, SEEK_END);
+	long end = ftell(file);
+	long start = YVM_HEADER_SIZE + (long)code_count * 8;
+	if((header[2] & YVM_HAS_DATA) != 0) {
+		uint32_t data_size = 0;
+		fseek(file, start + 6, SEEK_SET);
+		if(fread(&data_size, 4, 1, file) != 1) {
+			fclose(file);
+			return NULL;
+		}
+		start += YVM_DATA_HEADER + (long)data_size;
+	}
+	if(end <= start) {
+		fclose(file);
+		return NULL;
+	}
+	uint8_t* data = malloc(end - start);
+	fseek(file, start, SEEK_SET);
+	size_t got = fread(data, 1, end - start, file);
+	fclose(file);
+	YvmDebugInfo* info = yvm_parse_debug_info(data, got);
+	free(data);
+	return info;
+}
+
+// last entry with addr <= `addr`, the tables are sorted by address
+int __debug_floor(const void* table, uint32_t count, size_t entry_size, uint32_t addr) {
+	int lo = 0;
+	int hi = (int)count - 1;
+	int found = -1;
+	while(lo <= hi) {
+		int mid = lo + (hi - lo) / 2;
+		uint32_t mid_addr = *(const uint32_t*)((const uint8_t*)table + (size_t)mid * entry_size);
+		if(mid_addr <= addr) {
+			found = mid;
+			lo = mid + 1;
+		} else {
+			hi = mid - 1;
+		}
+	}
+	return found;
+}
+
+const YvmLine* yvm_debug_line_at(const YvmDebugInfo* info, int addr) {
+	if(info == NULL || addr < 0) {
+		return NULL;
+	}
+	int i = __debug_floor(info->lines, info->line_count, sizeof(YvmLine), (uint32_t)addr);
+	return i < 0 ? NULL : &info->lines[i];
+}
+
+// name of the label `addr` belongs to, `offset` receives the distance
+const char* yvm_debug_label_at(const YvmDebugInfo* info, int addr, int* offset) {
+	if(info == NULL || addr < 0) {
+		return NULL;
+	}
+	int i = __debug_floor(info->labels, info->label_count, sizeof(YvmSym), (uint32_t)addr);
+	if(i < 0) {
+		return NULL;
+	}
+	*offset = addr - (int)info->labels[i].addr;
+	return info->strings[info->labels[i].name];
+}
+
+// callee name if `addr` is the jump of a `call`
+const char* yvm_debug_callee_at(const YvmDebugInfo* info, int addr) {
+	if(info == NULL || addr < 0) {
+		return NULL;
+	}
+	int i = __debug_floor(info->calls, info->call_count, sizeof(YvmSym), (uint32_t)addr);
+	if(i < 0 || info->calls[i].addr != (uint32_t)addr) {
+		return NULL;
+	}
+	return info->strings[info->calls[i].name];
+}
+
+#endif // __YVM_DEBUGINFO_H__
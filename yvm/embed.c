@@ -0,0 +1,39 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "yvm.h"
+#include "ydb.h"
+#include "aio.h"
+#include "filemap.h"
+#include "embed.h"
+
+int yvm_run_image(const void* image, size_t size, bool debug) {
+	YulaVM* _Yvm = malloc(sizeof(YulaVM));
+	init_yvm(_Yvm, YVM_MEM_CAPACITY);
+
+	YvmHostTable host;
+	yvm_host_init(&host);
+	YvmAio* aio = malloc(sizeof(YvmAio));
+	init_yvm_aio(aio, false);
+	yvm_aio_install(&host, aio);
+	yvm_filemap_install(&host, aio);
+	_Yvm->host = &host;
+
+	yvm_load_image(_Yvm, image, size, debug);
+	if(debug) {
+		if(!ydb_run(_Yvm, NULL)) {
+			_Yvm->exit_code = 1;
+		}
+	} else {
+		yvm_exec_prog(_Yvm);
+	}
+
+	int exit_code = _Yvm->exit_code;
+	destroy_yvm_aio(aio);
+	free(aio);
+	yvm_release_mappings(_Yvm);
+	yvm_free_debug_info(_Yvm->debug_info);
+	yvm_detach_program(_Yvm);
+	free(_Yvm->memory);
+	free(_Yvm);
+	return exit_code;
+}
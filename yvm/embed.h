@@ -0,0 +1,20 @@
+#ifndef __YVM_EMBED_H__
+
+#define __YVM_EMBED_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// runs a bytecode image (the contents of a .bin file) in this process
+// returns the exit code of the program
+int yvm_run_image(const void* image, size_t size, bool debug);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __YVM_EMBED_H__
@@ -0,0 +1,154 @@
+#ifndef __YVM_FILEMAP_H__
+
+#define __YVM_FILEMAP_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "yvm.h"
+#include "aio.h"
+
+// Host files mapped into the VM address space. Mappings are placed
+// above the flat memory starting at YVM_MAP_BASE, 64K aligned, and are
+// reached with the same addresses as ordinary memory: load/store and
+// the buffers of the I/O syscalls go through yvm_mem_ptr, which
+// enforces the bounds of each mapping and rejects stores to read-only
+// ones with ERR_BAD_ACCESS. yvm_release_mappings unmaps them all.
+//
+//   map   (9)   [path_addr path_len flags] -> VM address or -errno, flags: 0 read-only, 1 copy-on-write
+//   unmap (10)  [addr]                     -> 0 or -errno
+// unmap gives -EBUSY while an io_read or io_write into the mapping is
+// in flight, io_wait for it first.
+
+#define YVM_SYSCALL_MAP 9
+#define YVM_SYSCALL_UNMAP 10
+#define YVM_MAP_ALIGN 0x10000
+#define YVM_MAP_PATH_MAX 256
+
+// first free address after the existing mappings
+int64_t __filemap_next_addr(const YulaVM* yvm) {
+	int64_t next = YVM_MAP_BASE;
+	for(int i = 0;i < yvm->map_count;++i) {
+		int64_t end = (int64_t)yvm->maps[i].addr + yvm->maps[i].len;
+		end = (end + YVM_MAP_ALIGN - 1) / YVM_MAP_ALIGN * YVM_MAP_ALIGN;
+		if(end > next) {
+			next = end;
+		}
+	}
+	return next;
+}
+
+// maps `size` bytes of `fd`, NULL on failure
+uint8_t* __filemap_host(int fd, size_t size, bool writable) {
+#ifndef _WIN32
+	void* data = mmap(NULL, size, PROT_READ | (writable ? PROT_WRITE : 0), MAP_PRIVATE, fd, 0);
+	return data == MAP_FAILED ? NULL : data;
+#else
+	// no mmap, a private copy behaves like copy-on-write
+	(void)writable;
+	uint8_t* data = malloc(size);
+	if(data != NULL && read(fd, data, (unsigned)size) != (int)size) {
+		free(data);
+		return NULL;
+	}
+	return data;
+#endif
+}
+
+Err __host_map(YulaVM* yvm, void* ctx) {
+	(void)ctx;
+	int* flags = yvm_arg(yvm, 0);
+	int* len = yvm_arg(yvm, 1);
+	int* addr = yvm_arg(yvm, 2);
+	if(addr == NULL) {
+		return ERR_STACK_UNDERFLOW;
+	}
+	const uint8_t* path_bytes = yvm_mem_ptr(yvm, *addr, *len, false);
+	bool writable = *flags == 1;
+	Err e = yvm_drop(yvm, 3);
+	if(path_bytes == NULL || *len >= YVM_MAP_PATH_MAX) {
+		yvm->v1 = -EFAULT;
+		return e;
+	}
+	if(yvm->map_count == YVM_MAX_MAPPINGS) {
+		yvm->v1 = -ENOMEM;
+		return e;
+	}
+	char path[YVM_MAP_PATH_MAX];
+	memcpy(path, path_bytes, *len);
+	path[*len] = '\0';
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) {
+		yvm->v1 = -errno;
+		return e;
+	}
+	struct stat st;
+	int64_t at = __filemap_next_addr(yvm);
+	if(fstat(fd, &st) != 0 || st.st_size <= 0 || at + st.st_size > INT32_MAX) {
+		close(fd);
+		yvm->v1 = -EINVAL;
+		return e;
+	}
+	uint8_t* data = __filemap_host(fd, (size_t)st.st_size, writable);
+	int saved = errno;
+	close(fd);
+	if(data == NULL) {
+		yvm->v1 = -saved;
+		return e;
+	}
+	YvmMapping* m = &yvm->maps[yvm->map_count++];
+	m->addr = (int)at;
+	m->len = (int)st.st_size;
+	m->writable = writable;
+	m->data = data;
+	yvm->v1 = m->addr;
+	return e;
+}
+
+// true when a pending io_read or io_write still holds a buffer in `m`
+bool __filemap_in_flight(const YvmAio* aio, const YvmMapping* m) {
+	for(int i = 0;i < YVM_AIO_SLOTS;++i) {
+		const YvmAioSlot* slot = &aio->slots[i];
+		if(__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) == YVM_AIO_PENDING && slot->op != YVM_AIO_OPEN
+			&& slot->buf >= m->data && slot->buf < m->data + m->len) {
+			return true;
+		}
+	}
+	return false;
+}
+
+Err __host_unmap(YulaVM* yvm, void* ctx) {
+	YvmAio* aio = ctx;
+	int* addr = yvm_arg(yvm, 0);
+	if(addr == NULL) {
+		return ERR_STACK_UNDERFLOW;
+	}
+	yvm->v1 = -EINVAL;
+	for(int i = 0;i < yvm->map_count;++i) {
+		if(yvm->maps[i].addr == *addr) {
+			if(__filemap_in_flight(aio, &yvm->maps[i])) {
+				yvm->v1 = -EBUSY;
+				break;
+			}
+			yvm_release_mapping(&yvm->maps[i]);
+			yvm->maps[i] = yvm->maps[--yvm->map_count];
+			yvm->v1 = 0;
+			break;
+		}
+	}
+	return yvm_drop(yvm, 1);
+}
+
+// `aio` is the table's io_* state, unmap checks its requests
+void yvm_filemap_install(YvmHostTable* table, YvmAio* aio) {
+	yvm_host_register(table, YVM_SYSCALL_MAP, "map", __host_map, NULL);
+	yvm_host_register(table, YVM_SYSCALL_UNMAP, "unmap", __host_unmap, aio);
+}
+
+#endif // __YVM_FILEMAP_H__
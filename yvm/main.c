@@ -4,10 +4,33 @@
 #include "yvm.h"
 #include "binfiles.h"
 #include "arena.h"
+#include "profile.h"
+#include "sampler.h"
+#include "ydb.h"
+#include "trace.h"
+#include "snapshot.h"
+#include "budget.h"
+#include "aio.h"
+#include "filemap.h"
+#include "regir.h"
+#include "codecache.h"
 
 void usage(FILE* stream) {
 	fputs("Incorrect usage... Correct is:\n", stream);
-	fputs("yvm <input.bin>\n", stream);
+	fputs("yvm <input.bin> [flags]\n", stream);
+	fputs("    -d           run the program under ydb\n", stream);
+	fputs("    --script <file>          ydb commands to run before reading stdin\n", stream);
+	fputs("    --profile    count executed instructions and report on exit\n", stream);
+	fputs("    --sample <out.folded>    sample the running program, write folded stacks\n", stream);
+	fputs("    --sample-hz <n>          sampling frequency (default 997)\n", stream);
+	fputs("    --trace <out.ytr>        record an execution trace, inspect it with ytrace\n", stream);
+	fputs("    --snapshot <out.snap>    run to the snapshot syscall and save the state\n", stream);
+	fputs("    --restore <file.snap>    continue from a saved snapshot\n", stream);
+	fputs("    --fork-server            run each stdin line as a request forked at the snapshot\n", stream);
+	fputs("    --fuel <n>               stop after about n instructions\n", stream);
+	fputs("    --timeout <ms>           stop after ms milliseconds\n", stream);
+	fputs("    --regir                  translate to register form at load and run that\n", stream);
+	fputs("    --no-code-cache          with --regir, do not use or write <input>.yrc\n", stream);
 }
 
 int main(int argc, const char* argv[]) {
@@ -20,23 +43,245 @@ int main(int argc, const char* argv[]) {
 	YulaVM* _Yvm = malloc(sizeof(YulaVM));
 	init_yvm(_Yvm, YVM_MEM_CAPACITY);
 	
+	uint8_t header[YVM_HEADER_SIZE];
+	if(!read_bin_header(argv[1], (char*)header)) {
+		fprintf(stderr, "ERROR: cannot read `%s`\n", argv[1]);
+		exit(1);
+	}
 	FILE_SIZE = get_file_size_wp(argv[1]);
-	Instr* buffer = (Instr*)malloc(FILE_SIZE);
-	read_bin_file(argv[1], (char*)buffer);
+	// only the code is read here, the debug section is loaded on demand
+	size_t code_count = yvm_code_count(header, FILE_SIZE);
+	if(code_count > YVM_CODE_CAPACITY) {
+		fprintf(stderr, "ERROR: program too large (%zu instructions, max %d)\n", code_count, YVM_CODE_CAPACITY);
+		exit(1);
+	}
+	if(YVM_HEADER_SIZE + code_count * sizeof(Instr) > (size_t)FILE_SIZE) {
+		fputs("ERROR: corrupted yvm bytecode\n", stderr);
+		exit(1);
+	}
+	Instr* buffer = (Instr*)malloc(code_count * sizeof(Instr) + 1);
+	if(!read_bin_file_n(argv[1], (char*)buffer, code_count * sizeof(Instr))) {
+		fprintf(stderr, "ERROR: cannot read `%s`\n", argv[1]);
+		exit(1);
+	}
 
-	yvm_load_bytecode(_Yvm, buffer, (FILE_SIZE - 8) / sizeof(Instr), tmp_buf);
+	yvm_load_bytecode(_Yvm, buffer, code_count, tmp_buf);
+	if(!yvm_read_data_file(_Yvm->program, argv[1], header, code_count)) {
+		fputs("ERROR: corrupted yvm bytecode\n", stderr);
+		exit(1);
+	}
+	yvm_init_data(_Yvm);
 	
 	bool debug = false;
-	if(argc > 2) {
-		if(strcmp(argv[2], "-d") == 0) {
+	bool profile = false;
+	const char* sample_path = NULL;
+	const char* script_path = NULL;
+	const char* trace_path = NULL;
+	const char* snapshot_path = NULL;
+	const char* restore_path = NULL;
+	bool fork_server = false;
+	bool regir = false;
+	bool code_cache = true;
+	int64_t fuel = 0;
+	uint64_t timeout_ms = 0;
+	int sample_hz = 997;
+	for(int i = 2;i < argc;++i) {
+		if(strcmp(argv[i], "-d") == 0) {
+			debug = true;
+		}
+		else if(strcmp(argv[i], "--profile") == 0) {
+			profile = true;
+		}
+		else if(strcmp(argv[i], "--sample") == 0 && i + 1 < argc) {
+			sample_path = argv[++i];
+		}
+		else if(strcmp(argv[i], "--script") == 0 && i + 1 < argc) {
+			script_path = argv[++i];
 			debug = true;
 		}
+		else if(strcmp(argv[i], "--sample-hz") == 0 && i + 1 < argc) {
+			sample_hz = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			trace_path = argv[++i];
+		}
+		else if(strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) {
+			snapshot_path = argv[++i];
+		}
+		else if(strcmp(argv[i], "--restore") == 0 && i + 1 < argc) {
+			restore_path = argv[++i];
+		}
+		else if(strcmp(argv[i], "--fork-server") == 0) {
+			fork_server = true;
+		}
+		else if(strcmp(argv[i], "--regir") == 0) {
+			regir = true;
+		}
+		else if(strcmp(argv[i], "--no-code-cache") == 0) {
+			code_cache = false;
+		}
+		else if(strcmp(argv[i], "--fuel") == 0 && i + 1 < argc) {
+			fuel = strtoll(argv[++i], NULL, 10);
+		}
+		else if(strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+			timeout_ms = strtoull(argv[++i], NULL, 10);
+		}
 	}
 
-	yvm_exec_prog(_Yvm, debug);
+	// each of these picks the loop the program runs in
+	int modes = (snapshot_path != NULL) + fork_server + profile + (trace_path != NULL) + (sample_path != NULL)
+		+ debug + (fuel > 0 || timeout_ms > 0) + regir;
+	if(modes > 1) {
+		fputs("ERROR: --snapshot, --fork-server, --profile, --trace, --sample, -d, --fuel/--timeout and --regir cannot be combined\n", stderr);
+		exit(1);
+	}
 
+	if(debug || profile || sample_path != NULL) {
+		_Yvm->debug_info = yvm_load_debug_info(argv[1]);
+	}
+
+	YvmHostTable host;
+	yvm_host_init(&host);
+	YvmAio* aio = malloc(sizeof(YvmAio));
+	init_yvm_aio(aio, false);
+	yvm_aio_install(&host, aio);
+	yvm_filemap_install(&host, aio);
+	_Yvm->host = &host;
+
+	bool mapped = false;
+	if(restore_path != NULL) {
+		YvmSnapshot snap;
+		if(!yvm_snapshot_map(_Yvm, restore_path, &snap)) {
+			fprintf(stderr, "ERROR: cannot restore `%s`\n", restore_path);
+			exit(1);
+		}
+		if(snap.code_hash != yvm_code_hash(_Yvm)) {
+			fprintf(stderr, "ERROR: `%s` was taken from a different program\n", restore_path);
+			exit(1);
+		}
+		mapped = true;
+	}
+	if(snapshot_path != NULL || (fork_server && restore_path == NULL)) {
+		Err e = yvm_exec_until_snapshot(_Yvm);
+		if(e == ERR_OK) {
+			fputs("ERROR: the program ended before the snapshot syscall\n", stderr);
+			exit(1);
+		}
+		if(e != ERR_SNAPSHOT) {
+			fprintf(stderr, "SIGNAL: %s\n", err_as_cstr(e));
+			err_destroy_yvm(_Yvm);
+		}
+	}
+
+	if(snapshot_path != NULL) {
+		if(!yvm_aio_idle(aio)) {
+			// a request in flight may still write VM memory, and its ticket
+			// or an open fd means nothing in the process that restores
+			fputs("ERROR: cannot snapshot with io_* requests in flight or files open\n", stderr);
+			exit(1);
+		}
+		YvmSnapshot snap;
+		yvm_snapshot_take(_Yvm, &snap);
+		if(!yvm_snapshot_write(&snap, snapshot_path)) {
+			fprintf(stderr, "ERROR: cannot write `%s`\n", snapshot_path);
+			exit(1);
+		}
+		yvm_snapshot_free(&snap);
+	} else if(fork_server) {
+		if(aio->backend != YVM_AIO_NONE) {
+			// pool threads do not survive fork and an io_uring ring would be
+			// shared with every child
+			fputs("ERROR: the fork server cannot start after the prologue used io_*\n", stderr);
+			exit(1);
+		}
+		yvm_fork_server(_Yvm, stdin);
+	} else if(profile) {
+		YvmProfile prof;
+		init_yvm_profile(&prof, _Yvm->code_size);
+		Err e = yvm_exec_prog_profiled(_Yvm, &prof);
+		fflush(stdout);
+		yvm_profile_report(_Yvm, &prof, stderr);
+		destroy_yvm_profile(&prof);
+		if(e != ERR_OK) {
+			fprintf(stderr, "SIGNAL: %s\n", err_as_cstr(e));
+			err_destroy_yvm(_Yvm);
+		}
+	} else if(trace_path != NULL) {
+		YvmTrace* trace = malloc(sizeof(YvmTrace));
+		init_yvm_trace(trace);
+		Err e = yvm_exec_prog_traced(_Yvm, trace);
+		fflush(stdout);
+		if(!yvm_trace_write(trace, trace_path)) {
+			fprintf(stderr, "ERROR: cannot write `%s`\n", trace_path);
+		}
+		destroy_yvm_trace(trace);
+		free(trace);
+		if(e != ERR_OK) {
+			fprintf(stderr, "SIGNAL: %s\n", err_as_cstr(e));
+			err_destroy_yvm(_Yvm);
+		}
+	} else if(sample_path != NULL) {
+		FILE* out = fopen(sample_path, "w");
+		if(out == NULL) {
+			fprintf(stderr, "ERROR: cannot write `%s`\n", sample_path);
+			exit(1);
+		}
+		if(!yvm_sampler_start(_Yvm, sample_hz)) {
+			exit(1);
+		}
+		Err e = yvm_exec_prog_sampled(_Yvm);
+		yvm_sampler_stop();
+		fflush(stdout);
+		yvm_sampler_report(_Yvm, out);
+		fclose(out);
+		if(e != ERR_OK) {
+			fprintf(stderr, "SIGNAL: %s\n", err_as_cstr(e));
+			err_destroy_yvm(_Yvm);
+		}
+	} else if(debug) {
+		if(!ydb_run(_Yvm, script_path)) {
+			err_destroy_yvm(_Yvm);
+		}
+	} else if(fuel > 0 || timeout_ms > 0) {
+		YvmBudget budget;
+		init_yvm_budget(&budget, fuel, timeout_ms * 1000000ULL);
+		Err e = yvm_exec_budgeted(_Yvm, &budget);
+		if(e != ERR_OK) {
+			fflush(stdout);
+			fprintf(stderr, "SIGNAL: %s after %llu instructions (ip %d)\n", err_as_cstr(e),
+				(unsigned long long)budget.executed, _Yvm->ip);
+			err_destroy_yvm(_Yvm);
+		}
+	} else if(regir) {
+		Err e;
+		if(code_cache) {
+			YvmCodeCache cache;
+			yvm_code_cache_load(&cache, argv[1], _Yvm->code, _Yvm->code_size);
+			e = yvm_exec_regir(_Yvm, &cache.prog);
+			yvm_code_cache_release(&cache);
+		} else {
+			e = yvm_exec_regir(_Yvm, yvm_program_regir(_Yvm->program));
+		}
+		if(e != ERR_OK) {
+			fprintf(stderr, "SIGNAL: %s\n", err_as_cstr(e));
+			err_destroy_yvm(_Yvm);
+		}
+	} else {
+		yvm_exec_prog(_Yvm);
+	}
+
+	int exit_code = _Yvm->exit_code;
+	destroy_yvm_aio(aio);
+	free(aio);
+	yvm_release_mappings(_Yvm);
+	if(mapped) {
+		yvm_snapshot_unmap(_Yvm);
+	}
+	yvm_free_debug_info(_Yvm->debug_info);
+	yvm_detach_program(_Yvm);
+	free(_Yvm->memory);
 	free(_Yvm);
 	free(buffer);
 
-	return 0;
+	return exit_code;
 }
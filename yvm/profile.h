@@ -0,0 +1,161 @@
+#ifndef __YVM_PROFILE_H__
+
+#define __YVM_PROFILE_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "yvm.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define YVM_CLOCK_UNIT "cycles"
+static inline uint64_t __yvm_clock(void) {
+	return __rdtsc();
+}
+#else
+#define YVM_CLOCK_UNIT "ns"
+static inline uint64_t __yvm_clock(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+#define YVM_OPCODE_COUNT (INSTR_JTAB + 1)
+#define YVM_PROFILE_SYSCALLS 16
+#define YVM_PROFILE_TOP 20
+
+typedef struct YvmProfile {
+	uint64_t total;
+	uint64_t per_opcode[YVM_OPCODE_COUNT];
+	uint64_t* per_addr;
+	// the last slot collects syscall numbers out of range
+	uint64_t syscall_count[YVM_PROFILE_SYSCALLS + 1];
+	uint64_t syscall_clock[YVM_PROFILE_SYSCALLS + 1];
+} YvmProfile;
+
+void init_yvm_profile(YvmProfile* prof, int code_size) {
+	memset(prof, 0, sizeof(YvmProfile));
+	prof->per_addr = calloc(code_size > 0 ? code_size : 1, sizeof(uint64_t));
+}
+
+void destroy_yvm_profile(YvmProfile* prof) {
+	free(prof->per_addr);
+	prof->per_addr = NULL;
+}
+
+// a separate loop so the normal one pays nothing for profiling
+Err yvm_exec_prog_profiled(YulaVM* yvm, YvmProfile* prof) {
+	for(;yvm->ip < yvm->code_size;) {
+		Instr cur_inst = yvm->code[yvm->ip];
+		prof->per_addr[yvm->ip] += 1;
+		if(cur_inst.type == INSTR_SYSCALL) {
+			int no = (yvm->v0 >= 0 && yvm->v0 < YVM_PROFILE_SYSCALLS) ? yvm->v0 : YVM_PROFILE_SYSCALLS;
+			uint64_t start = __yvm_clock();
+			Err e = __yvm_dispatch(yvm, cur_inst);
+			prof->syscall_clock[no] += __yvm_clock() - start;
+			prof->syscall_count[no] += 1;
+			if(e != ERR_OK) {
+				return e;
+			}
+			continue;
+		}
+		Err e = __yvm_dispatch(yvm, cur_inst);
+		if(e != ERR_OK) {
+			return e;
+		}
+	}
+	return ERR_OK;
+}
+
+// finds the closest jump target at or before `addr`, used as L<addr>
+// when the bytecode carries no debug section
+int __yvm_enclosing_target(YulaVM* yvm, int addr) {
+	int best = 0;
+	for(int i = 0;i < yvm->code_size;++i) {
+		Instr in = yvm->code[i];
+		if(in.type != INSTR_JMP) {
+			continue;
+		}
+		if(in.operand <= addr && in.operand > best && in.operand < yvm->code_size) {
+			best = in.operand;
+		}
+	}
+	return best;
+}
+
+void yvm_profile_report(YulaVM* yvm, YvmProfile* prof, FILE* stream) {
+	// per-opcode counts are derived from the address counts so the
+	// profiled loop only touches one counter per instruction
+	for(int i = 0;i < yvm->code_size;++i) {
+		int type = yvm->code[i].type;
+		if(type >= 0 && type < YVM_OPCODE_COUNT) {
+			prof->per_opcode[type] += prof->per_addr[i];
+		}
+		prof->total += prof->per_addr[i];
+	}
+	double total = prof->total > 0 ? (double)prof->total : 1.0;
+
+	fprintf(stream, "profile(YVM) {\n");
+	fprintf(stream, "    executed: %llu,\n", (unsigned long long)prof->total);
+	fprintf(stream, "    opcodes {\n");
+	for(int i = 0;i < YVM_OPCODE_COUNT;++i) {
+		if(prof->per_opcode[i] == 0) {
+			continue;
+		}
+		fprintf(stream, "        %-8s %12llu  %6.2f%%\n", inst_as_cstr((InstrType)i),
+			(unsigned long long)prof->per_opcode[i], 100.0 * (double)prof->per_opcode[i] / total);
+	}
+	fprintf(stream, "    }\n");
+	fprintf(stream, "    syscalls {\n");
+	for(int i = 0;i <= YVM_PROFILE_SYSCALLS;++i) {
+		if(prof->syscall_count[i] == 0) {
+			continue;
+		}
+		if(i == YVM_PROFILE_SYSCALLS) fprintf(stream, "        other ");
+		else fprintf(stream, "        %-5d ", i);
+		fprintf(stream, "%12llu calls  %14llu " YVM_CLOCK_UNIT "  %10.1f avg\n",
+			(unsigned long long)prof->syscall_count[i], (unsigned long long)prof->syscall_clock[i],
+			(double)prof->syscall_clock[i] / (double)prof->syscall_count[i]);
+	}
+	fprintf(stream, "    }\n");
+	fprintf(stream, "    hot {\n");
+	// selection of the top entries, the report runs once
+	bool* taken = calloc(yvm->code_size > 0 ? yvm->code_size : 1, sizeof(bool));
+	for(int n = 0;n < YVM_PROFILE_TOP;++n) {
+		int best = -1;
+		for(int i = 0;i < yvm->code_size;++i) {
+			if(!taken[i] && prof->per_addr[i] > 0 && (best == -1 || prof->per_addr[i] > prof->per_addr[best])) {
+				best = i;
+			}
+		}
+		if(best == -1) {
+			break;
+		}
+		taken[best] = true;
+		fprintf(stream, "        %6d %12llu  %6.2f%%  ", best,
+			(unsigned long long)prof->per_addr[best], 100.0 * (double)prof->per_addr[best] / total);
+		int offset = 0;
+		const char* label = yvm_debug_label_at(yvm->debug_info, best, &offset);
+		const YvmLine* line = yvm_debug_line_at(yvm->debug_info, best);
+		if(label != NULL) {
+			fprintf(stream, "%s+%d  ", label, offset);
+		} else {
+			int target = __yvm_enclosing_target(yvm, best);
+			fprintf(stream, "L%d+%d  ", target, best - target);
+		}
+		fprintf(stream, "%s %d", inst_as_cstr(yvm->code[best].type), yvm->code[best].operand);
+		if(line != NULL) {
+			fprintf(stream, "  (%s %u:%u)", yvm->debug_info->strings[line->file], line->line, line->col);
+		}
+		fputc('\n', stream);
+	}
+	free(taken);
+	fprintf(stream, "    }\n");
+	fprintf(stream, "}\n");
+}
+
+#endif // __YVM_PROFILE_H__
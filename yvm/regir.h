@@ -0,0 +1,717 @@
+#ifndef __YVM_REGIR_H__
+
+#define __YVM_REGIR_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include "yvm.h"
+
+// Register form of the stack code, built at load time. Each basic block
+// is run through a virtual stack: pushes of literals and registers only
+// record where the value lives, and arithmetic becomes three-address
+// ops on a register file of v0, v1, bp, temporaries and one slot per
+// literal. `rpush v0; push 3; add; pop v1` is a single `add v1, v0, c`.
+// Values still on the virtual stack are written to memory at the end of
+// the block and before anything that can see the memory stack (spush,
+// load, store, syscalls), so memory at and below sp matches the stack
+// code. Slots above sp that only held intermediate values are not
+// written.
+//
+// A block starts with a guard holding the highest push and lowest pop
+// of its stack code relative to sp. When the block could overflow or
+// underflow, it runs in the stack interpreter instead, so stack errors
+// are signalled at the same instruction.
+//
+// Literals pushed by the program do not split blocks. An address that
+// sjmp can reach through a literal gets its own copy of the rest of its
+// block instead, and sjmp to any other address continues in the
+// interpreter up to the next block. Literals in arithmetic are folded,
+// so a `call` costs no ops for its return address.
+
+// registers: v0, v1, bp, temporaries, then the literals
+#define YVM_REGIR_V0 0
+#define YVM_REGIR_V1 1
+#define YVM_REGIR_BP 2
+#define YVM_REGIR_TEMPS 32
+#define YVM_REGIR_CONST_BASE (3 + YVM_REGIR_TEMPS)
+// deeper virtual stacks are written out
+#define YVM_REGIR_DEPTH 64
+
+typedef enum YvmRegKind {
+	REGIR_BLOCK,   // guard, arg: highest push offset, arg2: lowest pop offset
+	REGIR_MOV,     // dst = a
+	REGIR_ADD,     // dst = a + b
+	REGIR_SUB,
+	REGIR_MUL,
+	REGIR_DIV,
+	REGIR_PUSH,    // memory stack <- a
+	REGIR_POP,     // dst <- memory stack
+	REGIR_SPUSH,   // memory stack <- sp
+	REGIR_LOAD,    // dst = [a]
+	REGIR_STORE,   // [a] = b
+	REGIR_JMP,     // arg: op index
+	REGIR_GOTO,    // arg: address outside the code
+	REGIR_SJMP,    // to the address in a
+	REGIR_SJMP_MEM,// to the address on the memory stack
+	REGIR_JTAB,    // through the jtab table at ip, index in a, arg: table size
+	REGIR_SYSCALL,
+	REGIR_INTERP,  // instruction without a register form, run by the interpreter
+	REGIR_END,
+} YvmRegKind;
+
+typedef struct YvmRegOp {
+	uint16_t kind;
+	uint16_t dst;
+	uint16_t a;
+	uint16_t b;
+	int32_t arg;
+	int32_t arg2;
+	int32_t ip; // stack instruction the op comes from
+} YvmRegOp;
+
+typedef struct YvmRegProg {
+	YvmRegOp* ops;
+	int op_count;
+	int* consts;
+	int const_count;
+	int* entry; // op index of the block starting at each address, -1 inside blocks
+	int code_size;
+} YvmRegProg;
+
+typedef struct __RegirBuilder {
+	YvmRegProg* prog;
+	int op_cap;
+	int const_cap;
+	uint16_t stack[YVM_REGIR_DEPTH];
+	int depth;
+	uint16_t free_temps[YVM_REGIR_TEMPS];
+	int free_count;
+	int block_start; // first op of the current block
+} __RegirBuilder;
+
+static int __regir_emit(__RegirBuilder* b, YvmRegKind kind, int dst, int x, int y, int ip) {
+	YvmRegProg* prog = b->prog;
+	if(prog->op_count == b->op_cap) {
+		b->op_cap *= 2;
+		prog->ops = realloc(prog->ops, sizeof(YvmRegOp) * b->op_cap);
+	}
+	YvmRegOp* op = &prog->ops[prog->op_count];
+	op->kind = kind;
+	op->dst = (uint16_t)dst;
+	op->a = (uint16_t)x;
+	op->b = (uint16_t)y;
+	op->arg = 0;
+	op->arg2 = 0;
+	op->ip = ip;
+	return prog->op_count++;
+}
+
+static bool __regir_is_temp(int reg) {
+	return reg > YVM_REGIR_BP && reg < YVM_REGIR_CONST_BASE;
+}
+
+static void __regir_release(__RegirBuilder* b, int reg) {
+	if(__regir_is_temp(reg)) {
+		b->free_temps[b->free_count++] = (uint16_t)reg;
+	}
+}
+
+// writes the virtual stack to memory, bottom first
+static void __regir_flush(__RegirBuilder* b, int ip) {
+	for(int i = 0;i < b->depth;++i) {
+		__regir_emit(b, REGIR_PUSH, 0, b->stack[i], 0, ip);
+		__regir_release(b, b->stack[i]);
+	}
+	b->depth = 0;
+}
+
+static int __regir_temp(__RegirBuilder* b, int ip) {
+	if(b->free_count == 0) {
+		__regir_flush(b, ip);
+	}
+	return b->free_temps[--b->free_count];
+}
+
+static void __regir_push(__RegirBuilder* b, int reg, int ip) {
+	if(b->depth == YVM_REGIR_DEPTH) {
+		__regir_flush(b, ip);
+	}
+	b->stack[b->depth++] = (uint16_t)reg;
+}
+
+// the top value, popped from memory into a temporary when the virtual stack is empty
+static int __regir_pop(__RegirBuilder* b, int ip) {
+	if(b->depth > 0) {
+		return b->stack[--b->depth];
+	}
+	int t = __regir_temp(b, ip);
+	__regir_emit(b, REGIR_POP, t, 0, 0, ip);
+	return t;
+}
+
+static int __regir_const(__RegirBuilder* b, int value) {
+	YvmRegProg* prog = b->prog;
+	if(prog->const_count == b->const_cap) {
+		b->const_cap *= 2;
+		prog->consts = realloc(prog->consts, sizeof(int) * b->const_cap);
+	}
+	prog->consts[prog->const_count] = value;
+	return YVM_REGIR_CONST_BASE + prog->const_count++;
+}
+
+// copies virtual stack entries reading `reg` before it is overwritten
+static void __regir_spill(__RegirBuilder* b, int reg, int ip) {
+	for(int i = 0;i < b->depth;++i) {
+		if(b->stack[i] != reg) {
+			continue;
+		}
+		if(b->free_count == 0) {
+			__regir_flush(b, ip);
+			return;
+		}
+		int t = b->free_temps[--b->free_count];
+		__regir_emit(b, REGIR_MOV, t, reg, 0, ip);
+		b->stack[i] = (uint16_t)t;
+	}
+}
+
+static int __regir_reg(int operand) {
+	return operand == REG_V1 ? YVM_REGIR_V1 : YVM_REGIR_V0;
+}
+
+// pop v: the value is moved into v, or the op that computed it writes v directly
+static void __regir_pop_reg(__RegirBuilder* b, int reg, int ip) {
+	__regir_spill(b, reg, ip);
+	if(b->depth == 0) {
+		__regir_emit(b, REGIR_POP, reg, 0, 0, ip);
+		return;
+	}
+	int value = b->stack[--b->depth];
+	YvmRegProg* prog = b->prog;
+	YvmRegOp* last = prog->op_count > b->block_start ? &prog->ops[prog->op_count - 1] : NULL;
+	if(__regir_is_temp(value) && last != NULL && last->dst == value
+		&& (last->kind == REGIR_MOV || (last->kind >= REGIR_ADD && last->kind <= REGIR_DIV)
+			|| last->kind == REGIR_POP || last->kind == REGIR_LOAD)) {
+		last->dst = (uint16_t)reg;
+	}
+	else if(value != reg) {
+		__regir_emit(b, REGIR_MOV, reg, value, 0, ip);
+	}
+	__regir_release(b, value);
+}
+
+static bool __regir_is_const(int reg) {
+	return reg >= YVM_REGIR_CONST_BASE;
+}
+
+// literal operands are computed here, `ipush; push 3; add` is one literal
+static bool __regir_fold(__RegirBuilder* b, YvmRegKind kind, int x, int y, int* out) {
+	if(!__regir_is_const(x) || !__regir_is_const(y)) {
+		return false;
+	}
+	uint32_t one = (uint32_t)b->prog->consts[x - YVM_REGIR_CONST_BASE];
+	uint32_t two = (uint32_t)b->prog->consts[y - YVM_REGIR_CONST_BASE];
+	switch(kind) {
+	case REGIR_ADD: *out = (int)(one + two); return true;
+	case REGIR_SUB: *out = (int)(one - two); return true;
+	case REGIR_MUL: *out = (int)(one * two); return true;
+	default: return false; // division faults are left to run time
+	}
+}
+
+static void __regir_binop(__RegirBuilder* b, YvmRegKind kind, int ip) {
+	int y = __regir_pop(b, ip);
+	int x = __regir_pop(b, ip);
+	int folded;
+	if(__regir_fold(b, kind, x, y, &folded)) {
+		__regir_push(b, __regir_const(b, folded), ip);
+		return;
+	}
+	__regir_release(b, x);
+	__regir_release(b, y);
+	int t = __regir_temp(b, ip);
+	__regir_emit(b, kind, t, x, y, ip);
+	__regir_push(b, t, ip);
+}
+
+// a guard offset no sp can reach
+#define YVM_REGIR_NO_CHECK (YVM_MEM_CAPACITY * 4)
+
+// offsets of sp relative to the block start at every checked push and pop
+static void __regir_guard(const Instr* code, int from, int to, int* max_push, int* min_pop) {
+	int off = 0;
+	*max_push = -YVM_REGIR_NO_CHECK;
+	*min_pop = YVM_REGIR_NO_CHECK;
+	for(int i = from;i < to;++i) {
+		switch(code[i].type) {
+		case INSTR_PUSH:
+		case INSTR_PUSH_IP:
+		case INSTR_PUSH_BP:
+		case INSTR_PUSH_SP:
+		case INSTR_RPUSH:
+			if(off > *max_push) *max_push = off;
+			off += 4;
+			break;
+		case INSTR_POP:
+		case INSTR_JMP_ONSTACK:
+		case INSTR_JTAB:
+			if(off < *min_pop) *min_pop = off;
+			off -= 4;
+			break;
+		case INSTR_ADD:
+		case INSTR_SUB:
+		case INSTR_MUL:
+		case INSTR_DIV:
+			// the result goes into a slot just popped, unchecked
+			if(off - 4 < *min_pop) *min_pop = off - 4;
+			off -= 4;
+			break;
+		case INSTR_LOAD:
+			if(off < *min_pop) *min_pop = off;
+			if(off - 4 > *max_push) *max_push = off - 4;
+			break;
+		case INSTR_STORE:
+			if(off - 4 < *min_pop) *min_pop = off - 4;
+			off -= 8;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+// addresses that start a block: jump targets, return addresses, and
+// whatever follows a jump or a syscall
+static bool* __regir_leaders(const Instr* code, int count) {
+	bool* leaders = calloc(count + 1, sizeof(bool));
+	leaders[0] = true;
+	leaders[count] = true;
+	for(int i = 0;i < count;++i) {
+		int op = code[i].operand;
+		switch(code[i].type) {
+		case INSTR_JMP:
+			if(op >= 0 && op < count) leaders[op] = true;
+			leaders[i + 1] = true;
+			break;
+		case INSTR_PUSH_IP:
+		case INSTR_JMP_ONSTACK:
+			leaders[i + 1] = true;
+			break;
+		case INSTR_JTAB:
+			// the table is jmp words, they mark the targets
+			leaders[i + 1] = true;
+			if(op < 0 || op >= count - i - 1) {
+				leaders[i] = true;
+			}
+			break;
+		case INSTR_SYSCALL:
+		case INSTR_TRAP:
+			leaders[i] = true;
+			leaders[i + 1] = true;
+			break;
+		case INSTR_PUSH:
+		case INSTR_MOV_V0:
+		case INSTR_MOV_V1:
+		case INSTR_POP:
+		case INSTR_ADD:
+		case INSTR_SUB:
+		case INSTR_MUL:
+		case INSTR_DIV:
+		case INSTR_RPUSH:
+		case INSTR_PUSH_BP:
+		case INSTR_PUSH_SP:
+		case INSTR_LOAD:
+		case INSTR_STORE:
+			break;
+		default:
+			leaders[i] = true;
+			leaders[i + 1] = true;
+			break;
+		}
+	}
+	return leaders;
+}
+
+static void __regir_instr(__RegirBuilder* b, const Instr* code, int count, int i) {
+	Instr in = code[i];
+	switch(in.type) {
+	case INSTR_PUSH:
+		__regir_push(b, __regir_const(b, in.operand), i);
+		break;
+	case INSTR_PUSH_IP:
+		__regir_push(b, __regir_const(b, i + 1), i);
+		break;
+	case INSTR_PUSH_BP:
+		__regir_push(b, YVM_REGIR_BP, i);
+		break;
+	case INSTR_RPUSH:
+		__regir_push(b, __regir_reg(in.operand), i);
+		break;
+	case INSTR_PUSH_SP:
+		__regir_flush(b, i);
+		__regir_emit(b, REGIR_SPUSH, 0, 0, 0, i);
+		break;
+	case INSTR_POP:
+		__regir_pop_reg(b, __regir_reg(in.operand), i);
+		break;
+	case INSTR_MOV_V0:
+	case INSTR_MOV_V1:
+	{
+		int reg = in.type == INSTR_MOV_V0 ? YVM_REGIR_V0 : YVM_REGIR_V1;
+		__regir_spill(b, reg, i);
+		__regir_emit(b, REGIR_MOV, reg, __regir_const(b, in.operand), 0, i);
+		break;
+	}
+	case INSTR_ADD:
+		__regir_binop(b, REGIR_ADD, i);
+		break;
+	case INSTR_SUB:
+		__regir_binop(b, REGIR_SUB, i);
+		break;
+	case INSTR_MUL:
+		__regir_binop(b, REGIR_MUL, i);
+		break;
+	case INSTR_DIV:
+		__regir_binop(b, REGIR_DIV, i);
+		break;
+	case INSTR_LOAD:
+	{
+		int addr = __regir_pop(b, i);
+		__regir_flush(b, i);
+		__regir_release(b, addr);
+		int t = __regir_temp(b, i);
+		__regir_emit(b, REGIR_LOAD, t, addr, 0, i);
+		__regir_push(b, t, i);
+		break;
+	}
+	case INSTR_STORE:
+	{
+		int value = __regir_pop(b, i);
+		int addr = __regir_pop(b, i);
+		__regir_flush(b, i);
+		__regir_emit(b, REGIR_STORE, 0, addr, value, i);
+		__regir_release(b, addr);
+		__regir_release(b, value);
+		break;
+	}
+	case INSTR_JMP:
+	{
+		__regir_flush(b, i);
+		bool inside = in.operand >= 0 && in.operand < count;
+		int op = __regir_emit(b, inside ? REGIR_JMP : REGIR_GOTO, 0, 0, 0, i);
+		b->prog->ops[op].arg = in.operand; // an address until the blocks are known
+		break;
+	}
+	case INSTR_JTAB:
+		if(in.operand >= 0 && in.operand < count - i - 1) {
+			int index = __regir_pop(b, i);
+			__regir_flush(b, i);
+			int op = __regir_emit(b, REGIR_JTAB, 0, index, 0, i);
+			b->prog->ops[op].arg = in.operand;
+			__regir_release(b, index);
+		} else {
+			// a table past the end, the interpreter signals it
+			__regir_flush(b, i);
+			__regir_emit(b, REGIR_INTERP, 0, 0, 0, i);
+		}
+		break;
+	case INSTR_JMP_ONSTACK:
+		if(b->depth > 0) {
+			int target = b->stack[--b->depth];
+			__regir_flush(b, i);
+			__regir_emit(b, REGIR_SJMP, 0, target, 0, i);
+			__regir_release(b, target);
+		} else {
+			__regir_emit(b, REGIR_SJMP_MEM, 0, 0, 0, i);
+		}
+		break;
+	case INSTR_SYSCALL:
+		__regir_flush(b, i);
+		__regir_emit(b, REGIR_SYSCALL, 0, 0, 0, i);
+		break;
+	default:
+		__regir_flush(b, i);
+		__regir_emit(b, REGIR_INTERP, 0, 0, 0, i);
+		break;
+	}
+}
+
+// one block from `from` up to the next leader
+static void __regir_block(__RegirBuilder* b, const Instr* code, int count, const bool* leaders, int from) {
+	YvmRegProg* prog = b->prog;
+	int end = from + 1;
+	while(end < count && !leaders[end]) {
+		++end;
+	}
+	b->block_start = __regir_emit(b, REGIR_BLOCK, 0, 0, 0, from);
+	__regir_guard(code, from, end, &prog->ops[b->block_start].arg, &prog->ops[b->block_start].arg2);
+	prog->entry[from] = b->block_start;
+	for(int ip = from;ip < end;++ip) {
+		__regir_instr(b, code, count, ip);
+	}
+	__regir_flush(b, end);
+}
+
+void yvm_regir_translate(YvmRegProg* prog, const Instr* code, int count) {
+	__RegirBuilder b;
+	memset(&b, 0, sizeof(b));
+	b.prog = prog;
+	b.op_cap = count + 16;
+	b.const_cap = count + 16;
+	prog->ops = malloc(sizeof(YvmRegOp) * b.op_cap);
+	prog->op_count = 0;
+	prog->consts = malloc(sizeof(int) * b.const_cap);
+	prog->const_count = 0;
+	prog->entry = malloc(sizeof(int) * (count + 1));
+	prog->code_size = count;
+	for(int ip = 0;ip <= count;++ip) {
+		prog->entry[ip] = -1;
+	}
+	for(int t = 0;t < YVM_REGIR_TEMPS;++t) {
+		b.free_temps[b.free_count++] = (uint16_t)(YVM_REGIR_CONST_BASE - 1 - t);
+	}
+
+	bool* leaders = __regir_leaders(code, count);
+	for(int i = 0;i < count;++i) {
+		if(leaders[i]) {
+			__regir_block(&b, code, count, leaders, i);
+		}
+	}
+	prog->entry[count] = __regir_emit(&b, REGIR_END, 0, 0, 0, count);
+	// literals an sjmp may use get their own copy of the rest of their
+	// block, the main blocks are not split at every small constant
+	int budget = prog->op_count + 4 * count;
+	for(int i = 0;i < count && prog->op_count < budget;++i) {
+		int t = code[i].operand;
+		if(code[i].type != INSTR_PUSH || t < 0 || t >= count || prog->entry[t] >= 0) {
+			continue;
+		}
+		__regir_block(&b, code, count, leaders, t);
+		int end = t + 1;
+		while(end < count && !leaders[end]) {
+			++end;
+		}
+		InstrType last = code[end - 1].type;
+		if(last != INSTR_JMP && last != INSTR_JMP_ONSTACK && last != INSTR_JTAB) {
+			int op = __regir_emit(&b, REGIR_JMP, 0, 0, 0, end);
+			prog->ops[op].arg = end;
+		}
+	}
+	for(int i = 0;i < prog->op_count;++i) {
+		if(prog->ops[i].kind == REGIR_JMP) {
+			prog->ops[i].arg = prog->entry[prog->ops[i].arg];
+		}
+	}
+	free(leaders);
+}
+
+void destroy_yvm_regir(YvmRegProg* prog) {
+	free(prog->ops);
+	free(prog->consts);
+	free(prog->entry);
+}
+
+typedef struct __RegirDecoded {
+	YvmDecoded base;
+	YvmRegProg prog;
+} __RegirDecoded;
+
+static void __regir_destroy_decoded(YvmDecoded* decoded) {
+	destroy_yvm_regir(&((__RegirDecoded*)decoded)->prog);
+	free(decoded);
+}
+
+// the register form of a shared program, translated by the first VM
+// that needs it and then used by all of them
+const YvmRegProg* yvm_program_regir(YvmProgram* program) {
+	YvmDecoded* decoded = __atomic_load_n(&program->decoded, __ATOMIC_ACQUIRE);
+	if(decoded == NULL) {
+		__RegirDecoded* fresh = malloc(sizeof(__RegirDecoded));
+		fresh->base.destroy = __regir_destroy_decoded;
+		yvm_regir_translate(&fresh->prog, program->code, program->code_size);
+		// another VM may have been faster, its translation is kept
+		if(!__atomic_compare_exchange_n(&program->decoded, &decoded, &fresh->base, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			__regir_destroy_decoded(&fresh->base);
+		} else {
+			decoded = &fresh->base;
+		}
+	}
+	return &((__RegirDecoded*)decoded)->prog;
+}
+
+// runs the stack code from yvm->ip up to the next block start
+static Err __regir_interpret(YulaVM* yvm, const YvmRegProg* prog) {
+	do {
+		Err e = yvm_exec_instr(yvm);
+		if(e != ERR_OK) {
+			return e;
+		}
+	} while(yvm->ip >= 0 && yvm->ip < prog->code_size && prog->entry[yvm->ip] < 0);
+	return ERR_OK;
+}
+
+// the register loop, yvm->code must hold the program `prog` was built from
+Err yvm_exec_regir(YulaVM* yvm, const YvmRegProg* prog) {
+	int* r = malloc(sizeof(int) * (YVM_REGIR_CONST_BASE + prog->const_count));
+	memcpy(r + YVM_REGIR_CONST_BASE, prog->consts, sizeof(int) * prog->const_count);
+	r[YVM_REGIR_V0] = yvm->v0;
+	r[YVM_REGIR_V1] = yvm->v1;
+	r[YVM_REGIR_BP] = yvm->stack_base;
+	uint8_t* mem = yvm->memory;
+	int sp = yvm->stack_head;
+	int ip = yvm->ip;
+	int pc = 0;
+	Err e = ERR_OK;
+	const YvmRegOp* ops = prog->ops;
+
+	goto resolve;
+	for(;;) {
+		const YvmRegOp* op = &ops[pc];
+		switch(op->kind) {
+		case REGIR_BLOCK:
+			if(sp + op->arg >= YVM_MEM_CAPACITY || sp + op->arg2 < r[YVM_REGIR_BP]) {
+				ip = op->ip;
+				goto interpret;
+			}
+			++pc;
+			break;
+		case REGIR_MOV:
+			r[op->dst] = r[op->a];
+			++pc;
+			break;
+		case REGIR_ADD:
+			r[op->dst] = (int)((uint32_t)r[op->a] + (uint32_t)r[op->b]);
+			++pc;
+			break;
+		case REGIR_SUB:
+			r[op->dst] = (int)((uint32_t)r[op->a] - (uint32_t)r[op->b]);
+			++pc;
+			break;
+		case REGIR_MUL:
+			r[op->dst] = (int)((uint32_t)r[op->a] * (uint32_t)r[op->b]);
+			++pc;
+			break;
+		case REGIR_DIV:
+			r[op->dst] = r[op->a] / r[op->b];
+			++pc;
+			break;
+		case REGIR_PUSH:
+			memcpy(&mem[sp], &r[op->a], 4);
+			sp += 4;
+			++pc;
+			break;
+		case REGIR_POP:
+			sp -= 4;
+			memcpy(&r[op->dst], &mem[sp], 4);
+			++pc;
+			break;
+		case REGIR_SPUSH:
+			memcpy(&mem[sp], &sp, 4);
+			sp += 4;
+			++pc;
+			break;
+		case REGIR_LOAD:
+		{
+			int addr = r[op->a];
+			const uint8_t* src = addr >= 0 && addr <= YVM_MEM_CAPACITY - 4 ? &mem[addr] : yvm_mem_ptr(yvm, addr, 4, false);
+			if(src == NULL) {
+				e = ERR_BAD_ACCESS;
+				ip = op->ip;
+				goto out;
+			}
+			memcpy(&r[op->dst], src, 4);
+			++pc;
+			break;
+		}
+		case REGIR_STORE:
+		{
+			int addr = r[op->a];
+			uint8_t* dst = addr >= 0 && addr <= YVM_MEM_CAPACITY - 4 ? &mem[addr] : yvm_mem_ptr(yvm, addr, 4, true);
+			if(dst == NULL) {
+				e = ERR_BAD_ACCESS;
+				ip = op->ip;
+				goto out;
+			}
+			memcpy(dst, &r[op->b], 4);
+			++pc;
+			break;
+		}
+		case REGIR_JMP:
+			pc = op->arg;
+			break;
+		case REGIR_GOTO:
+			ip = op->arg;
+			goto resolve;
+		case REGIR_SJMP:
+			ip = r[op->a];
+			goto resolve;
+		case REGIR_SJMP_MEM:
+			sp -= 4;
+			memcpy(&ip, &mem[sp], 4);
+			goto resolve;
+		case REGIR_JTAB:
+		{
+			unsigned index = (unsigned)r[op->a];
+			ip = yvm->code[op->ip + 1 + (index < (unsigned)op->arg ? index + 1 : 0)].operand;
+			goto resolve;
+		}
+		case REGIR_SYSCALL:
+			yvm->v0 = r[YVM_REGIR_V0];
+			yvm->v1 = r[YVM_REGIR_V1];
+			yvm->stack_head = sp;
+			yvm->ip = op->ip + 1;
+			e = __invoke_syscall(yvm);
+			r[YVM_REGIR_V0] = yvm->v0;
+			r[YVM_REGIR_V1] = yvm->v1;
+			sp = yvm->stack_head;
+			mem = yvm->memory;
+			ip = yvm->ip;
+			if(e != ERR_OK) {
+				goto out;
+			}
+			goto resolve;
+		case REGIR_INTERP:
+			ip = op->ip;
+			goto interpret;
+		case REGIR_END:
+			ip = op->ip;
+			goto out;
+		}
+		continue;
+	resolve:
+		if(ip >= prog->code_size) {
+			goto out;
+		}
+		if(ip >= 0 && prog->entry[ip] >= 0) {
+			pc = prog->entry[ip];
+			continue;
+		}
+	interpret:
+		yvm->v0 = r[YVM_REGIR_V0];
+		yvm->v1 = r[YVM_REGIR_V1];
+		yvm->stack_head = sp;
+		yvm->ip = ip;
+		e = __regir_interpret(yvm, prog);
+		r[YVM_REGIR_V0] = yvm->v0;
+		r[YVM_REGIR_V1] = yvm->v1;
+		sp = yvm->stack_head;
+		mem = yvm->memory;
+		ip = yvm->ip;
+		if(e != ERR_OK) {
+			goto out;
+		}
+		goto resolve;
+	}
+out:
+	yvm->v0 = r[YVM_REGIR_V0];
+	yvm->v1 = r[YVM_REGIR_V1];
+	yvm->stack_head = sp;
+	yvm->ip = ip;
+	free(r);
+	return e;
+}
+
+#endif // __YVM_REGIR_H__
@@ -0,0 +1,296 @@
+#ifndef __YVM_SAMPLER_H__
+
+#define __YVM_SAMPLER_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <signal.h>
+#include "yvm.h"
+#include "profile.h"
+
+// Timer driven sampling profiler. A SIGPROF handler copies the current ip
+// and the return addresses found on the VM stack into a small ring, the
+// sampled run loop drains the ring at jumps and syscalls into a hash of
+// distinct stacks with their counts. Memory grows with the number of
+// distinct stacks, not with the length of the run. On exit the stacks
+// are folded into "caller;callee;leaf count" lines for flamegraph.pl and
+// similar tools.
+
+#define YVM_SAMPLE_DEPTH 64
+// samples the handler can queue between two drains
+#define YVM_SAMPLE_RING 256
+#define YVM_SAMPLE_MIN_STACKS 256
+
+typedef struct YvmSample {
+	int ip;
+	int depth;
+	int frames[YVM_SAMPLE_DEPTH]; // return addresses, innermost first
+} YvmSample;
+
+typedef struct YvmStackCount {
+	YvmSample stack;
+	uint64_t count; // 0 for a free slot
+} YvmStackCount;
+
+typedef struct YvmSampler {
+	YulaVM* yvm;
+	YvmSample ring[YVM_SAMPLE_RING];
+	volatile sig_atomic_t head; // next slot the handler fills
+	volatile sig_atomic_t tail; // next slot the run loop drains
+	volatile sig_atomic_t dropped;
+	YvmStackCount* stacks; // open addressing, at most half full
+	size_t stack_cap;
+	size_t stack_count;
+} YvmSampler;
+
+static YvmSampler __yvm_sampler;
+// set by SIGINT/SIGTERM, the sampled loop stops at the next jump
+static volatile sig_atomic_t __yvm_sample_stop;
+
+// a return address pushed by `call` points right after the sequence
+// ipush; push 3; add; jmp <callee>
+static inline bool __yvm_is_return_addr(const YulaVM* yvm, int addr) {
+	return addr >= 4 && addr <= yvm->code_size
+		&& yvm->code[addr - 1].type == INSTR_JMP
+		&& yvm->code[addr - 2].type == INSTR_ADD
+		&& yvm->code[addr - 3].type == INSTR_PUSH && yvm->code[addr - 3].operand == 3
+		&& yvm->code[addr - 4].type == INSTR_PUSH_IP;
+}
+
+static uint64_t __yvm_stack_hash(const YvmSample* sample) {
+	uint64_t hash = 14695981039346656037ull ^ (uint32_t)sample->ip;
+	for(int i = 0;i < sample->depth;++i) {
+		hash = (hash * 1099511628211ull) ^ (uint32_t)sample->frames[i];
+	}
+	return hash * 1099511628211ull;
+}
+
+static bool __yvm_stack_equal(const YvmSample* a, const YvmSample* b) {
+	return a->ip == b->ip && a->depth == b->depth
+		&& memcmp(a->frames, b->frames, sizeof(int) * (size_t)a->depth) == 0;
+}
+
+static void __yvm_stack_add(YvmSampler* s, const YvmSample* sample, uint64_t count) {
+	if(2 * (s->stack_count + 1) > s->stack_cap) {
+		YvmStackCount* old = s->stacks;
+		size_t old_cap = s->stack_cap;
+		s->stack_cap = old_cap > 0 ? old_cap * 2 : YVM_SAMPLE_MIN_STACKS;
+		s->stacks = calloc(s->stack_cap, sizeof(YvmStackCount));
+		s->stack_count = 0;
+		for(size_t i = 0;i < old_cap;++i) {
+			if(old[i].count > 0) {
+				__yvm_stack_add(s, &old[i].stack, old[i].count);
+			}
+		}
+		free(old);
+	}
+	size_t i = (size_t)__yvm_stack_hash(sample) & (s->stack_cap - 1);
+	while(s->stacks[i].count > 0 && !__yvm_stack_equal(&s->stacks[i].stack, sample)) {
+		i = (i + 1) & (s->stack_cap - 1);
+	}
+	if(s->stacks[i].count == 0) {
+		s->stacks[i].stack = *sample;
+		s->stack_count += 1;
+	}
+	s->stacks[i].count += count;
+}
+
+// folds the queued samples into the stack counts
+static inline void __yvm_sampler_drain(void) {
+	YvmSampler* s = &__yvm_sampler;
+	int head = s->head;
+	__atomic_signal_fence(__ATOMIC_ACQUIRE);
+	int tail = s->tail;
+	while(tail != head) {
+		__yvm_stack_add(s, &s->ring[tail], 1);
+		tail = (tail + 1) % YVM_SAMPLE_RING;
+	}
+	s->tail = tail;
+}
+
+// the plain loop plus the stop flag and a drain at every jump and
+// syscall, straight line code runs as fast as in yvm_exec_prog
+Err yvm_exec_prog_sampled(YulaVM* yvm) {
+	for(;yvm->ip < yvm->code_size;) {
+		int ip = yvm->ip;
+		Instr cur_inst = yvm->code[ip];
+		Err e = __yvm_dispatch(yvm, cur_inst);
+		if(e != ERR_OK) {
+			__yvm_sampler_drain();
+			return e;
+		}
+		if(yvm->ip != ip + 1 || cur_inst.type == INSTR_SYSCALL) {
+			if(__yvm_sample_stop) {
+				break;
+			}
+			if(__yvm_sampler.head != __yvm_sampler.tail) {
+				__yvm_sampler_drain();
+			}
+		}
+	}
+	__yvm_sampler_drain();
+	return ERR_OK;
+}
+
+#ifndef _WIN32
+
+#include <sys/time.h>
+
+static void __yvm_sample_handler(int sig) {
+	(void)sig;
+	YvmSampler* s = &__yvm_sampler;
+	int head = s->head;
+	int next = (head + 1) % YVM_SAMPLE_RING;
+	if(next == s->tail) {
+		s->dropped += 1;
+		return;
+	}
+	const YulaVM* yvm = s->yvm;
+	YvmSample* sample = &s->ring[head];
+	sample->ip = yvm->ip;
+	sample->depth = 0;
+	int sp = yvm->stack_head;
+	if(sp > YVM_MEM_CAPACITY) {
+		sp = YVM_MEM_CAPACITY;
+	}
+	for(sp -= 4;sp >= yvm->stack_base && sample->depth < YVM_SAMPLE_DEPTH;sp -= 4) {
+		int value;
+		memcpy(&value, &yvm->memory[sp], 4);
+		if(__yvm_is_return_addr(yvm, value)) {
+			sample->frames[sample->depth++] = value;
+		}
+	}
+	__atomic_signal_fence(__ATOMIC_RELEASE);
+	s->head = next;
+}
+
+// SIGINT/SIGTERM end the run so long runs can still be reported
+static void __yvm_sample_interrupt(int sig) {
+	(void)sig;
+	__yvm_sample_stop = 1;
+}
+
+bool yvm_sampler_start(YulaVM* yvm, int hz) {
+	__yvm_sampler.yvm = yvm;
+	__yvm_sampler.head = 0;
+	__yvm_sampler.tail = 0;
+	__yvm_sampler.dropped = 0;
+	__yvm_sampler.stacks = NULL;
+	__yvm_sampler.stack_cap = 0;
+	__yvm_sampler.stack_count = 0;
+	__yvm_sample_stop = 0;
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = __yvm_sample_handler;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	if(sigaction(SIGPROF, &sa, NULL) != 0) {
+		return false;
+	}
+	sa.sa_handler = __yvm_sample_interrupt;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	struct itimerval timer;
+	timer.it_interval.tv_sec = 0;
+	timer.it_interval.tv_usec = 1000000 / (hz > 0 ? hz : 1);
+	timer.it_value = timer.it_interval;
+	return setitimer(ITIMER_PROF, &timer, NULL) == 0;
+}
+
+void yvm_sampler_stop(void) {
+	struct itimerval timer;
+	memset(&timer, 0, sizeof(timer));
+	setitimer(ITIMER_PROF, &timer, NULL);
+	signal(SIGPROF, SIG_IGN);
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	__yvm_sampler_drain();
+}
+
+#else
+
+bool yvm_sampler_start(YulaVM* yvm, int hz) {
+	(void)yvm;
+	(void)hz;
+	fputs("ERROR: sampling is not supported on this platform\n", stderr);
+	return false;
+}
+
+void yvm_sampler_stop(void) {
+}
+
+#endif
+
+// appends the name of the function `addr` belongs to
+void __yvm_frame_name(YulaVM* yvm, int addr, char* out, size_t size) {
+	int offset = 0;
+	const char* label = yvm_debug_label_at(yvm->debug_info, addr, &offset);
+	size_t len = strlen(out);
+	if(label != NULL) {
+		snprintf(out + len, size - len, "%s", label);
+	} else {
+		snprintf(out + len, size - len, "L%d", __yvm_enclosing_target(yvm, addr));
+	}
+}
+
+typedef struct YvmFoldedLine {
+	char* line;
+	uint64_t count;
+} YvmFoldedLine;
+
+int __yvm_cmp_folded(const void* a, const void* b) {
+	return strcmp(((const YvmFoldedLine*)a)->line, ((const YvmFoldedLine*)b)->line);
+}
+
+// writes the folded stacks, one line per distinct stack with its count.
+// stacks differing only in call sites of the same functions fold into
+// one line
+void yvm_sampler_report(YulaVM* yvm, FILE* stream) {
+	YvmSampler* s = &__yvm_sampler;
+	size_t count = 0;
+	const size_t line_size = (YVM_SAMPLE_DEPTH + 1) * 64;
+	YvmFoldedLine* lines = malloc(sizeof(YvmFoldedLine) * (s->stack_count > 0 ? s->stack_count : 1));
+	for(size_t i = 0;i < s->stack_cap;++i) {
+		if(s->stacks[i].count == 0) {
+			continue;
+		}
+		const YvmSample* sample = &s->stacks[i].stack;
+		char* line = calloc(line_size, 1);
+		// outermost caller first, each frame is named by its call site
+		for(int f = sample->depth - 1;f >= 0;--f) {
+			__yvm_frame_name(yvm, sample->frames[f] - 1, line, line_size);
+			strncat(line, ";", line_size - strlen(line) - 1);
+		}
+		__yvm_frame_name(yvm, sample->ip, line, line_size);
+		lines[count].line = line;
+		lines[count].count = s->stacks[i].count;
+		count += 1;
+	}
+	qsort(lines, count, sizeof(YvmFoldedLine), __yvm_cmp_folded);
+	for(size_t i = 0;i < count;) {
+		size_t j = i;
+		uint64_t total = 0;
+		while(j < count && strcmp(lines[i].line, lines[j].line) == 0) {
+			total += lines[j].count;
+			++j;
+		}
+		fprintf(stream, "%s %llu\n", lines[i].line, (unsigned long long)total);
+		i = j;
+	}
+	for(size_t i = 0;i < count;++i) {
+		free(lines[i].line);
+	}
+	free(lines);
+	if(s->dropped > 0) {
+		fprintf(stderr, "WARNING: %d samples dropped, the run loop did not drain them in time\n", (int)s->dropped);
+	}
+	free(s->stacks);
+	s->stacks = NULL;
+	s->stack_cap = 0;
+	s->stack_count = 0;
+}
+
+#endif // __YVM_SAMPLER_H__
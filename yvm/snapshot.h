@@ -0,0 +1,224 @@
+#ifndef __YVM_SNAPSHOT_H__
+
+#define __YVM_SNAPSHOT_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include "yvm.h"
+
+// Snapshots of the VM state taken at the snapshot syscall (v0 = 3).
+// With yvm->snapshot_armed the syscall stops the run with ERR_SNAPSHOT,
+// ip already points after it, so restoring and running again continues
+// from there with the request input in v1. mappings are not part of a
+// snapshot, a program holding one stops with ERR_MAPPED_STATE instead.
+//
+// file: "YS" u8 version u8 reserved u32 code_hash, i32 ip v0 v1 bp sp,
+// u32 memory_size, zero padding up to YVM_SNAPSHOT_MEM_OFFSET, memory.
+// the memory starts on a page boundary so it can be mapped copy-on-write.
+
+#define YVM_SNAPSHOT_VERSION 1
+#define YVM_SNAPSHOT_MEM_OFFSET 4096
+
+typedef struct YvmSnapshot {
+	uint32_t code_hash;
+	int ip;
+	int v0;
+	int v1;
+	int stack_base;
+	int stack_head;
+	uint8_t* memory;
+} YvmSnapshot;
+
+// snapshots only apply to the program they were taken from
+uint32_t yvm_code_hash(const YulaVM* yvm) {
+	uint32_t hash = 2166136261u;
+	const uint8_t* bytes = (const uint8_t*)yvm->code;
+	for(size_t i = 0;i < (size_t)yvm->code_size * sizeof(Instr);++i) {
+		hash = (hash ^ bytes[i]) * 16777619u;
+	}
+	return hash;
+}
+
+// runs until the program ends or reaches the snapshot syscall
+Err yvm_exec_until_snapshot(YulaVM* yvm) {
+	yvm->snapshot_armed = true;
+	for(;yvm->ip < yvm->code_size;) {
+		Err e = yvm_exec_instr(yvm);
+		if(e != ERR_OK) {
+			yvm->snapshot_armed = false;
+			return e;
+		}
+	}
+	yvm->snapshot_armed = false;
+	return ERR_OK;
+}
+
+void yvm_snapshot_take(const YulaVM* yvm, YvmSnapshot* snap) {
+	snap->code_hash = yvm_code_hash(yvm);
+	snap->ip = yvm->ip;
+	snap->v0 = yvm->v0;
+	snap->v1 = yvm->v1;
+	snap->stack_base = yvm->stack_base;
+	snap->stack_head = yvm->stack_head;
+	snap->memory = malloc(YVM_MEM_CAPACITY);
+	memcpy(snap->memory, yvm->memory, YVM_MEM_CAPACITY);
+}
+
+void yvm_snapshot_free(YvmSnapshot* snap) {
+	free(snap->memory);
+	snap->memory = NULL;
+}
+
+void __snapshot_apply_regs(YulaVM* yvm, const YvmSnapshot* snap) {
+	yvm->ip = snap->ip;
+	yvm->v0 = snap->v0;
+	yvm->v1 = snap->v1;
+	yvm->stack_base = snap->stack_base;
+	yvm->stack_head = snap->stack_head;
+	yvm->exit_code = 0;
+}
+
+// in-memory restore, one copy of the memory and the registers
+void yvm_snapshot_restore(YulaVM* yvm, const YvmSnapshot* snap) {
+	memcpy(yvm->memory, snap->memory, YVM_MEM_CAPACITY);
+	__snapshot_apply_regs(yvm, snap);
+}
+
+bool yvm_snapshot_write(const YvmSnapshot* snap, const char* path) {
+	uint8_t header[YVM_SNAPSHOT_MEM_OFFSET];
+	memset(header, 0, sizeof(header));
+	header[0] = 'Y';
+	header[1] = 'S';
+	header[2] = YVM_SNAPSHOT_VERSION;
+	int32_t fields[7] = { (int32_t)snap->code_hash, snap->ip, snap->v0, snap->v1,
+		snap->stack_base, snap->stack_head, YVM_MEM_CAPACITY };
+	memcpy(header + 4, fields, sizeof(fields));
+	FILE* file = fopen(path, "wb");
+	if(file == NULL) {
+		return false;
+	}
+	fwrite(header, 1, sizeof(header), file);
+	fwrite(snap->memory, 1, YVM_MEM_CAPACITY, file);
+	bool ok = ferror(file) == 0;
+	return fclose(file) == 0 && ok;
+}
+
+bool __snapshot_parse_header(const uint8_t* header, YvmSnapshot* snap) {
+	int32_t fields[7];
+	memcpy(fields, header + 4, sizeof(fields));
+	if(header[0] != 'Y' || header[1] != 'S' || header[2] != YVM_SNAPSHOT_VERSION || fields[6] != YVM_MEM_CAPACITY) {
+		return false;
+	}
+	snap->code_hash = (uint32_t)fields[0];
+	snap->ip = fields[1];
+	snap->v0 = fields[2];
+	snap->v1 = fields[3];
+	snap->stack_base = fields[4];
+	snap->stack_head = fields[5];
+	return true;
+}
+
+#ifndef _WIN32
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+// maps the memory of a snapshot file copy-on-write, pages are only
+// copied when the program writes to them. the mapping replaces
+// yvm->memory and is released with yvm_snapshot_unmap
+bool yvm_snapshot_map(YulaVM* yvm, const char* path, YvmSnapshot* snap) {
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) {
+		return false;
+	}
+	uint8_t header[YVM_SNAPSHOT_MEM_OFFSET];
+	bool ok = read(fd, header, sizeof(header)) == (ssize_t)sizeof(header)
+		&& __snapshot_parse_header(header, snap)
+		&& YVM_SNAPSHOT_MEM_OFFSET % sysconf(_SC_PAGESIZE) == 0;
+	void* memory = MAP_FAILED;
+	if(ok) {
+		memory = mmap(NULL, YVM_MEM_CAPACITY, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, YVM_SNAPSHOT_MEM_OFFSET);
+	}
+	close(fd);
+	if(memory == MAP_FAILED) {
+		return false;
+	}
+	snap->memory = NULL;
+	free(yvm->memory);
+	yvm->memory = memory;
+	__snapshot_apply_regs(yvm, snap);
+	return true;
+}
+
+// puts back a heap allocation so the usual cleanup applies
+void yvm_snapshot_unmap(YulaVM* yvm) {
+	munmap(yvm->memory, YVM_MEM_CAPACITY);
+	yvm->memory = calloc(YVM_MEM_CAPACITY, 1);
+}
+
+// fork server: the VM sits at the snapshot point and every request line
+// on `input` (an integer, passed in v1) runs in a forked child, so the
+// kernel shares the prologue's memory copy-on-write. the child's output
+// goes to stdout, one "status: <exit code>" line per request to stderr
+void yvm_fork_server(YulaVM* yvm, FILE* input) {
+	char line[64];
+	fflush(stdout);
+	while(fgets(line, sizeof(line), input) != NULL) {
+		pid_t pid = fork();
+		if(pid < 0) {
+			perror("ERROR: fork");
+			return;
+		}
+		if(pid == 0) {
+			yvm->v1 = atoi(line);
+			yvm_exec_prog(yvm);
+			fflush(stdout);
+			_exit(yvm->exit_code);
+		}
+		int status = 0;
+		waitpid(pid, &status, 0);
+		if(WIFEXITED(status)) {
+			fprintf(stderr, "status: %d\n", WEXITSTATUS(status));
+		} else {
+			fprintf(stderr, "status: signal %d\n", WTERMSIG(status));
+		}
+	}
+}
+
+#else
+
+// no copy-on-write mapping on Windows, the memory is read instead
+bool yvm_snapshot_map(YulaVM* yvm, const char* path, YvmSnapshot* snap) {
+	FILE* file = fopen(path, "rb");
+	if(file == NULL) {
+		return false;
+	}
+	uint8_t header[YVM_SNAPSHOT_MEM_OFFSET];
+	bool ok = fread(header, 1, sizeof(header), file) == sizeof(header) && __snapshot_parse_header(header, snap)
+		&& fread(yvm->memory, 1, YVM_MEM_CAPACITY, file) == YVM_MEM_CAPACITY;
+	fclose(file);
+	if(ok) {
+		snap->memory = NULL;
+		__snapshot_apply_regs(yvm, snap);
+	}
+	return ok;
+}
+
+void yvm_snapshot_unmap(YulaVM* yvm) {
+	(void)yvm;
+}
+
+void yvm_fork_server(YulaVM* yvm, FILE* input) {
+	(void)yvm;
+	(void)input;
+	fputs("ERROR: the fork server is not supported on this platform\n", stderr);
+}
+
+#endif
+
+#endif // __YVM_SNAPSHOT_H__
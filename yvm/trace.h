@@ -0,0 +1,441 @@
+#ifndef __YVM_TRACE_H__
+
+#define __YVM_TRACE_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include "yvm.h"
+
+// Execution trace. The traced loop only writes an event when control
+// flow leaves the straight line (a jump, sjmp or syscall), everything in
+// between is a count. Events are varint encoded with ip deltas, so a
+// tight loop costs a few bytes per iteration. The log is a ring of
+// chunks, each starting with a keyframe (registers plus run length
+// encoded memory), so long runs keep only the most recent history and
+// replay starts from the nearest keyframe and re-executes the code.
+//
+// file: "YT" u8 version u8 status(Err) u64 steps u32 exit_code u32 chunk_count
+// chunk: u64 first_step u32 keyframe_size keyframe u32 data_size data
+// keyframe: zigzag ip v0 v1 bp sp, then memory as
+//   (varint zeros, varint literal_len, literal bytes) until it is covered
+// event: varint (run << 2 | kind), zigzag delta of the next ip from the
+//   one after the last instruction of the run, for syscalls also zigzag
+//   v0, v1 and sp after the call. an end event carries only the run.
+//
+// host syscalls other than the builtin ones may write memory, the next
+// chunk starts right after them so replay never crosses one. keyframes
+// do not hold mappings, the run stops with ERR_MAPPED_STATE once the
+// program maps a file.
+
+#define YVM_TRACE_VERSION 2
+#define YVM_TRACE_CHUNK_SIZE (64 * 1024)
+#define YVM_TRACE_CHUNKS 16
+// largest possible event, a chunk is closed when less than this is left
+#define YVM_TRACE_EVENT_MAX 32
+#define YVM_TRACE_KEYFRAME_MAX (YVM_MEM_CAPACITY * 2 + 64)
+
+typedef enum YvmTraceKind {
+	YVM_TRACE_JUMP = 0,
+	YVM_TRACE_SYSCALL = 1,
+	YVM_TRACE_END = 2,
+} YvmTraceKind;
+
+typedef struct YvmTraceEvent {
+	YvmTraceKind kind;
+	uint64_t run;
+	int32_t delta;
+	int32_t v0;
+	int32_t v1;
+	int32_t sp;
+} YvmTraceEvent;
+
+typedef struct YvmTraceChunk {
+	uint64_t first_step;
+	uint8_t* keyframe;
+	uint32_t keyframe_size;
+	uint8_t* data;
+	uint32_t size;
+} YvmTraceChunk;
+
+typedef struct YvmTrace {
+	YvmTraceChunk chunks[YVM_TRACE_CHUNKS];
+	uint64_t opened; // chunks ever opened, the current one is (opened - 1) % YVM_TRACE_CHUNKS
+	uint64_t steps;
+	Err status;
+	int exit_code;
+} YvmTrace;
+
+static inline void __trace_put_varint(uint8_t* buf, uint32_t* pos, uint64_t value) {
+	while(value >= 0x80) {
+		buf[(*pos)++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	buf[(*pos)++] = (uint8_t)value;
+}
+
+static inline void __trace_put_zigzag(uint8_t* buf, uint32_t* pos, int32_t value) {
+	__trace_put_varint(buf, pos, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+}
+
+static inline bool __trace_get_varint(const uint8_t* buf, uint32_t size, uint32_t* pos, uint64_t* value) {
+	*value = 0;
+	for(int shift = 0;shift < 64 && *pos < size;shift += 7) {
+		uint8_t byte = buf[(*pos)++];
+		*value |= (uint64_t)(byte & 0x7f) << shift;
+		if((byte & 0x80) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static inline bool __trace_get_zigzag(const uint8_t* buf, uint32_t size, uint32_t* pos, int32_t* value) {
+	uint64_t raw;
+	if(!__trace_get_varint(buf, size, pos, &raw)) {
+		return false;
+	}
+	*value = (int32_t)((uint32_t)(raw >> 1) ^ -(uint32_t)(raw & 1));
+	return true;
+}
+
+void init_yvm_trace(YvmTrace* tr) {
+	memset(tr, 0, sizeof(YvmTrace));
+}
+
+void destroy_yvm_trace(YvmTrace* tr) {
+	for(int i = 0;i < YVM_TRACE_CHUNKS;++i) {
+		free(tr->chunks[i].keyframe);
+		free(tr->chunks[i].data);
+	}
+	memset(tr, 0, sizeof(YvmTrace));
+}
+
+uint32_t __trace_encode_keyframe(const YulaVM* yvm, uint8_t* out) {
+	uint32_t pos = 0;
+	__trace_put_zigzag(out, &pos, yvm->ip);
+	__trace_put_zigzag(out, &pos, yvm->v0);
+	__trace_put_zigzag(out, &pos, yvm->v1);
+	__trace_put_zigzag(out, &pos, yvm->stack_base);
+	__trace_put_zigzag(out, &pos, yvm->stack_head);
+	const uint8_t* mem = yvm->memory;
+	int i = 0;
+	while(i < YVM_MEM_CAPACITY) {
+		int zeros = 0;
+		while(i + zeros < YVM_MEM_CAPACITY && mem[i + zeros] == 0) {
+			++zeros;
+		}
+		i += zeros;
+		// a literal ends at the first run of 4 zeros, shorter gaps are
+		// cheaper to copy than to encode
+		int len = 0;
+		while(i + len < YVM_MEM_CAPACITY) {
+			if(mem[i + len] == 0 && i + len + 4 <= YVM_MEM_CAPACITY && memcmp(&mem[i + len], "\0\0\0\0", 4) == 0) {
+				break;
+			}
+			++len;
+		}
+		__trace_put_varint(out, &pos, (uint64_t)zeros);
+		__trace_put_varint(out, &pos, (uint64_t)len);
+		memcpy(out + pos, mem + i, len);
+		pos += len;
+		i += len;
+	}
+	return pos;
+}
+
+bool __trace_decode_keyframe(YulaVM* yvm, const uint8_t* in, uint32_t size) {
+	uint32_t pos = 0;
+	bool ok = __trace_get_zigzag(in, size, &pos, &yvm->ip)
+		&& __trace_get_zigzag(in, size, &pos, &yvm->v0)
+		&& __trace_get_zigzag(in, size, &pos, &yvm->v1)
+		&& __trace_get_zigzag(in, size, &pos, &yvm->stack_base)
+		&& __trace_get_zigzag(in, size, &pos, &yvm->stack_head);
+	uint64_t i = 0;
+	while(ok && pos < size) {
+		uint64_t zeros;
+		uint64_t len;
+		ok = __trace_get_varint(in, size, &pos, &zeros) && __trace_get_varint(in, size, &pos, &len)
+			&& i + zeros + len <= YVM_MEM_CAPACITY && len <= size - pos;
+		if(!ok) {
+			break;
+		}
+		memset(yvm->memory + i, 0, zeros);
+		memcpy(yvm->memory + i + zeros, in + pos, len);
+		pos += (uint32_t)len;
+		i += zeros + len;
+	}
+	return ok && i == YVM_MEM_CAPACITY;
+}
+
+// starts the next chunk of the ring with a keyframe of the current state
+void __trace_open_chunk(YvmTrace* tr, const YulaVM* yvm) {
+	YvmTraceChunk* chunk = &tr->chunks[tr->opened % YVM_TRACE_CHUNKS];
+	if(chunk->data == NULL) {
+		chunk->data = malloc(YVM_TRACE_CHUNK_SIZE);
+		chunk->keyframe = malloc(YVM_TRACE_KEYFRAME_MAX);
+	}
+	chunk->first_step = tr->steps;
+	chunk->keyframe_size = __trace_encode_keyframe(yvm, chunk->keyframe);
+	chunk->size = 0;
+	tr->opened += 1;
+}
+
+// with `keyframe` set the next event goes to a new chunk
+static inline void __trace_event(YvmTrace* tr, const YulaVM* yvm, uint64_t* run, int next_ip, YvmTraceKind kind, bool keyframe) {
+	YvmTraceChunk* chunk = &tr->chunks[(tr->opened - 1) % YVM_TRACE_CHUNKS];
+	__trace_put_varint(chunk->data, &chunk->size, *run << 2 | kind);
+	if(kind != YVM_TRACE_END) {
+		__trace_put_zigzag(chunk->data, &chunk->size, yvm->ip - next_ip);
+	}
+	if(kind == YVM_TRACE_SYSCALL) {
+		__trace_put_zigzag(chunk->data, &chunk->size, yvm->v0);
+		__trace_put_zigzag(chunk->data, &chunk->size, yvm->v1);
+		__trace_put_zigzag(chunk->data, &chunk->size, yvm->stack_head);
+	}
+	tr->steps += *run;
+	*run = 0;
+	if(keyframe || chunk->size + YVM_TRACE_EVENT_MAX > YVM_TRACE_CHUNK_SIZE) {
+		__trace_open_chunk(tr, yvm);
+	}
+}
+
+bool __trace_read_event(const YvmTraceChunk* chunk, uint32_t* pos, YvmTraceEvent* ev) {
+	uint64_t header;
+	if(!__trace_get_varint(chunk->data, chunk->size, pos, &header)) {
+		return false;
+	}
+	ev->kind = (YvmTraceKind)(header & 3);
+	ev->run = header >> 2;
+	ev->delta = 0;
+	ev->v0 = 0;
+	ev->v1 = 0;
+	ev->sp = 0;
+	if(ev->kind != YVM_TRACE_END && !__trace_get_zigzag(chunk->data, chunk->size, pos, &ev->delta)) {
+		return false;
+	}
+	return ev->kind != YVM_TRACE_SYSCALL || (__trace_get_zigzag(chunk->data, chunk->size, pos, &ev->v0)
+		&& __trace_get_zigzag(chunk->data, chunk->size, pos, &ev->v1)
+		&& __trace_get_zigzag(chunk->data, chunk->size, pos, &ev->sp));
+}
+
+// the builtin services only touch registers, everything else (io, map,
+// host functions) may write memory or the stack behind the VM's back
+static inline bool __trace_syscall_pure(const YulaVM* yvm, int no) {
+	if(no < 0 || no >= YVM_SYSCALL_CAPACITY) {
+		return false;
+	}
+	YvmHostFn fn = yvm->host->fns[no];
+	return fn == __host_dump_state || fn == __host_dump_v1 || fn == __host_exit || fn == __host_snapshot;
+}
+
+#include <signal.h>
+
+// set by SIGINT/SIGTERM, like the sampler the traced loop then stops at
+// the next event so the trace still gets written
+static volatile sig_atomic_t __yvm_trace_stop;
+
+#ifndef _WIN32
+
+static void __yvm_trace_interrupt(int sig) {
+	(void)sig;
+	__yvm_trace_stop = 1;
+}
+
+void __yvm_trace_signals(bool on) {
+	__yvm_trace_stop = 0;
+	signal(SIGINT, on ? __yvm_trace_interrupt : SIG_DFL);
+	signal(SIGTERM, on ? __yvm_trace_interrupt : SIG_DFL);
+}
+
+#else
+
+void __yvm_trace_signals(bool on) {
+	(void)on;
+}
+
+#endif
+
+// a separate loop so the normal one pays nothing for tracing, straight
+// line code only bumps `run`
+Err yvm_exec_prog_traced(YulaVM* yvm, YvmTrace* tr) {
+	uint64_t run = 0;
+	Err e = ERR_OK;
+	__trace_open_chunk(tr, yvm);
+	__yvm_trace_signals(true);
+	for(;yvm->ip < yvm->code_size;) {
+		int ip = yvm->ip;
+		int no = yvm->v0;
+		Instr cur_inst = yvm->code[ip];
+		e = __yvm_dispatch(yvm, cur_inst);
+		if(e != ERR_OK) {
+			// the faulting instruction is not counted, replay stops before it
+			yvm->ip = ip;
+			break;
+		}
+		run += 1;
+		if(cur_inst.type == INSTR_SYSCALL) {
+			__trace_event(tr, yvm, &run, ip + 1, YVM_TRACE_SYSCALL, !__trace_syscall_pure(yvm, no));
+			if(yvm->map_count > 0) {
+				// keyframes cannot restore mappings, later loads would diverge
+				e = ERR_MAPPED_STATE;
+				break;
+			}
+		} else if(yvm->ip != ip + 1) {
+			__trace_event(tr, yvm, &run, ip + 1, YVM_TRACE_JUMP, false);
+		} else {
+			continue;
+		}
+		if(__yvm_trace_stop) {
+			break;
+		}
+	}
+	__yvm_trace_signals(false);
+	__trace_event(tr, yvm, &run, yvm->ip, YVM_TRACE_END, false);
+	tr->status = e;
+	tr->exit_code = yvm->exit_code;
+	return e;
+}
+
+static inline void __trace_write_u32(FILE* file, uint32_t value) {
+	fwrite(&value, 4, 1, file);
+}
+
+// writes the retained chunks, oldest first
+bool yvm_trace_write(const YvmTrace* tr, const char* path) {
+	FILE* file = fopen(path, "wb");
+	if(file == NULL) {
+		return false;
+	}
+	uint64_t retained = tr->opened < YVM_TRACE_CHUNKS ? tr->opened : YVM_TRACE_CHUNKS;
+	uint8_t head[4] = { 'Y', 'T', YVM_TRACE_VERSION, (uint8_t)tr->status };
+	fwrite(head, 1, 4, file);
+	fwrite(&tr->steps, 8, 1, file);
+	__trace_write_u32(file, (uint32_t)tr->exit_code);
+	__trace_write_u32(file, (uint32_t)retained);
+	for(uint64_t n = tr->opened - retained;n < tr->opened;++n) {
+		const YvmTraceChunk* chunk = &tr->chunks[n % YVM_TRACE_CHUNKS];
+		fwrite(&chunk->first_step, 8, 1, file);
+		__trace_write_u32(file, chunk->keyframe_size);
+		fwrite(chunk->keyframe, 1, chunk->keyframe_size, file);
+		__trace_write_u32(file, chunk->size);
+		fwrite(chunk->data, 1, chunk->size, file);
+	}
+	bool ok = ferror(file) == 0;
+	return fclose(file) == 0 && ok;
+}
+
+static inline bool __trace_read_u32(FILE* file, uint32_t* value) {
+	return fread(value, 4, 1, file) == 1;
+}
+
+// reads a trace written by yvm_trace_write, chunks are stored from
+// index 0 in file order
+bool yvm_trace_read(YvmTrace* tr, const char* path) {
+	init_yvm_trace(tr);
+	FILE* file = fopen(path, "rb");
+	if(file == NULL) {
+		return false;
+	}
+	uint8_t head[4];
+	uint32_t exit_code;
+	uint32_t count;
+	bool ok = fread(head, 1, 4, file) == 4 && head[0] == 'Y' && head[1] == 'T' && head[2] == YVM_TRACE_VERSION
+		&& fread(&tr->steps, 8, 1, file) == 1 && __trace_read_u32(file, &exit_code)
+		&& __trace_read_u32(file, &count) && count <= YVM_TRACE_CHUNKS;
+	if(ok) {
+		tr->status = (Err)head[3];
+		tr->exit_code = (int)exit_code;
+		tr->opened = count;
+	}
+	for(uint32_t i = 0;ok && i < count;++i) {
+		YvmTraceChunk* chunk = &tr->chunks[i];
+		ok = fread(&chunk->first_step, 8, 1, file) == 1 && __trace_read_u32(file, &chunk->keyframe_size)
+			&& chunk->keyframe_size <= YVM_TRACE_KEYFRAME_MAX;
+		if(!ok) {
+			break;
+		}
+		chunk->keyframe = malloc(chunk->keyframe_size + 1);
+		ok = fread(chunk->keyframe, 1, chunk->keyframe_size, file) == chunk->keyframe_size
+			&& __trace_read_u32(file, &chunk->size) && chunk->size <= YVM_TRACE_CHUNK_SIZE;
+		if(!ok) {
+			break;
+		}
+		chunk->data = malloc(chunk->size + 1);
+		ok = fread(chunk->data, 1, chunk->size, file) == chunk->size;
+	}
+	fclose(file);
+	if(!ok) {
+		destroy_yvm_trace(tr);
+	}
+	return ok;
+}
+
+// chunk of a read trace whose keyframe is the closest one at or before `step`
+int yvm_trace_chunk_for(const YvmTrace* tr, uint64_t step) {
+	int found = 0;
+	for(int i = 0;i < (int)tr->opened;++i) {
+		if(tr->chunks[i].first_step <= step) {
+			found = i;
+		}
+	}
+	return found;
+}
+
+typedef enum YvmReplayStatus {
+	YVM_REPLAY_OK,
+	YVM_REPLAY_CORRUPT,
+	YVM_REPLAY_DIVERGED, // the code does not match the recorded control flow
+} YvmReplayStatus;
+
+// restores the keyframe of `chunk` and re-executes up to `step`, syscalls
+// are not performed again, their recorded results are applied instead.
+// `yvm` must hold the same code the trace was recorded with
+YvmReplayStatus yvm_trace_replay(YulaVM* yvm, const YvmTrace* tr, int chunk_index, uint64_t step) {
+	const YvmTraceChunk* chunk = &tr->chunks[chunk_index];
+	if(!__trace_decode_keyframe(yvm, chunk->keyframe, chunk->keyframe_size)) {
+		return YVM_REPLAY_CORRUPT;
+	}
+	uint64_t cur = chunk->first_step;
+	uint32_t pos = 0;
+	while(cur < step && pos < chunk->size) {
+		YvmTraceEvent ev;
+		if(!__trace_read_event(chunk, &pos, &ev)) {
+			return YVM_REPLAY_CORRUPT;
+		}
+		YvmTraceKind kind = ev.kind;
+		uint64_t run = ev.run;
+		int32_t delta = ev.delta;
+		for(uint64_t k = 0;k < run;++k) {
+			if(cur == step) {
+				return YVM_REPLAY_OK;
+			}
+			int ip = yvm->ip;
+			if(ip < 0 || ip >= yvm->code_size) {
+				return YVM_REPLAY_DIVERGED;
+			}
+			Instr cur_inst = yvm->code[ip];
+			bool last = k + 1 == run && kind != YVM_TRACE_END;
+			if(last && kind == YVM_TRACE_SYSCALL) {
+				if(cur_inst.type != INSTR_SYSCALL) {
+					return YVM_REPLAY_DIVERGED;
+				}
+				yvm->v0 = ev.v0;
+				yvm->v1 = ev.v1;
+				yvm->stack_head = ev.sp;
+				yvm->ip = ip + 1 + delta;
+			} else if(cur_inst.type == INSTR_SYSCALL || __yvm_dispatch(yvm, cur_inst) != ERR_OK) {
+				return YVM_REPLAY_DIVERGED;
+			}
+			if(yvm->ip != ip + 1 + (last ? delta : 0)) {
+				return YVM_REPLAY_DIVERGED;
+			}
+			cur += 1;
+		}
+	}
+	return YVM_REPLAY_OK;
+}
+
+#endif // __YVM_TRACE_H__
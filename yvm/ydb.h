@@ -0,0 +1,399 @@
+#ifndef __YDB_H__
+
+#define __YDB_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include "yvm.h"
+
+// Breakpoint debugger. Breakpoints replace the instruction in the VM's
+// own copy of the code (yvm_private_code) with INSTR_TRAP, so `continue`
+// runs the plain dispatch loop until the trap fires. Only watchpoints
+// force instruction by instruction execution, and only while they exist.
+//
+// commands:
+//   break <addr|label>        set a breakpoint
+//   delete <n>                remove breakpoint or watchpoint n
+//                             (watchpoints are numbered from YDB_MAX_POINTS)
+//   watch mem <addr> <len>    stop when memory[addr, addr+len) changes
+//   watch v0|v1 [value]       stop when the register changes (or becomes value)
+//   continue | c              run until a breakpoint, watchpoint or exit
+//   step | s [n]              execute n instructions (default 1)
+//   regs                      show registers
+//   x <addr> [n]              show n stack words starting at memory[addr]
+//   info                      list breakpoints and watchpoints
+//   quit | q                  stop the program
+// lines starting with `#` are ignored, a script given with --script runs
+// first and the debugger reads stdin after it.
+
+#define YDB_MAX_POINTS 64
+
+typedef struct YdbBreak {
+	int addr;
+	Instr saved;
+	bool used;
+} YdbBreak;
+
+typedef enum YdbWatchKind {
+	YDB_WATCH_MEM,
+	YDB_WATCH_REG,
+} YdbWatchKind;
+
+typedef struct YdbWatch {
+	YdbWatchKind kind;
+	bool used;
+	int addr;
+	int len;
+	uint8_t* snapshot;
+	int reg;
+	bool has_value;
+	int value;
+	int last;
+} YdbWatch;
+
+typedef struct Ydb {
+	YulaVM* yvm;
+	YdbBreak breaks[YDB_MAX_POINTS];
+	YdbWatch watches[YDB_MAX_POINTS];
+	int watch_count;
+	FILE* script;
+} Ydb;
+
+YdbBreak* __ydb_break_at(Ydb* db, int addr) {
+	for(int i = 0;i < YDB_MAX_POINTS;++i) {
+		if(db->breaks[i].used && db->breaks[i].addr == addr) {
+			return &db->breaks[i];
+		}
+	}
+	return NULL;
+}
+
+// the instruction the program really has at `addr`
+Instr __ydb_instr_at(Ydb* db, int addr) {
+	YdbBreak* b = __ydb_break_at(db, addr);
+	return b != NULL ? b->saved : db->yvm->code[addr];
+}
+
+// resolves a number or, with a debug section, a label name
+bool __ydb_parse_addr(Ydb* db, const char* arg, int* addr) {
+	char* end;
+	long value = strtol(arg, &end, 10);
+	if(*arg != '\0' && *end == '\0') {
+		*addr = (int)value;
+		return true;
+	}
+	YvmDebugInfo* info = db->yvm->debug_info;
+	for(uint32_t i = 0;info != NULL && i < info->label_count;++i) {
+		if(strcmp(info->strings[info->labels[i].name], arg) == 0) {
+			*addr = (int)info->labels[i].addr;
+			return true;
+		}
+	}
+	return false;
+}
+
+void __ydb_show(Ydb* db) {
+	YulaVM* yvm = db->yvm;
+	if(yvm->ip >= yvm->code_size) {
+		return;
+	}
+	__process_debug_cstate(yvm, __ydb_instr_at(db, yvm->ip));
+	printf("    [ip %d]\n", yvm->ip);
+}
+
+// executes the instruction at ip, stepping over a breakpoint if needed
+Err __ydb_step(Ydb* db) {
+	YulaVM* yvm = db->yvm;
+	return __yvm_dispatch(yvm, __ydb_instr_at(db, yvm->ip));
+}
+
+// true if a watchpoint fired, reports it and takes a new snapshot
+bool __ydb_check_watches(Ydb* db) {
+	YulaVM* yvm = db->yvm;
+	bool hit = false;
+	for(int i = 0;i < YDB_MAX_POINTS;++i) {
+		YdbWatch* w = &db->watches[i];
+		if(!w->used) {
+			continue;
+		}
+		if(w->kind == YDB_WATCH_MEM) {
+			if(memcmp(w->snapshot, &yvm->memory[w->addr], w->len) != 0) {
+				printf("(ydb) watchpoint %d: memory[%d, %d) changed\n", YDB_MAX_POINTS + i, w->addr, w->addr + w->len);
+				memcpy(w->snapshot, &yvm->memory[w->addr], w->len);
+				hit = true;
+			}
+			continue;
+		}
+		int now = *__find_reg(yvm, w->reg);
+		bool fired = w->has_value ? (now == w->value && w->last != w->value) : now != w->last;
+		if(fired) {
+			printf("(ydb) watchpoint %d: %s %d -> %d\n", YDB_MAX_POINTS + i, __reg_no_to_cstr(w->reg), w->last, now);
+			hit = true;
+		}
+		w->last = now;
+	}
+	return hit;
+}
+
+// runs until a breakpoint, a watchpoint, the end or an error
+Err __ydb_continue(Ydb* db) {
+	YulaVM* yvm = db->yvm;
+	// leave the current breakpoint first
+	if(yvm->ip < yvm->code_size) {
+		Err e = __ydb_step(db);
+		if(e != ERR_OK) {
+			return e;
+		}
+		if(db->watch_count > 0 && __ydb_check_watches(db)) {
+			return ERR_OK;
+		}
+	}
+	if(db->watch_count > 0) {
+		for(;yvm->ip < yvm->code_size;) {
+			if(__ydb_break_at(db, yvm->ip) != NULL) {
+				return ERR_TRAP;
+			}
+			Err e = __yvm_dispatch(yvm, yvm->code[yvm->ip]);
+			if(e != ERR_OK) {
+				return e;
+			}
+			if(__ydb_check_watches(db)) {
+				return ERR_OK;
+			}
+		}
+		return ERR_OK;
+	}
+	for(;yvm->ip < yvm->code_size;) {
+		Err e = __yvm_dispatch(yvm, yvm->code[yvm->ip]);
+		if(e != ERR_OK) {
+			return e;
+		}
+	}
+	return ERR_OK;
+}
+
+bool __ydb_read_line(Ydb* db, char* line, size_t size) {
+	if(db->script != NULL) {
+		if(fgets(line, (int)size, db->script) != NULL) {
+			printf("%s", line);
+			if(strchr(line, '\n') == NULL) {
+				putchar('\n');
+			}
+			return true;
+		}
+		fclose(db->script);
+		db->script = NULL;
+	}
+	return fgets(line, (int)size, stdin) != NULL;
+}
+
+void __ydb_add_break(Ydb* db, const char* arg) {
+	int addr;
+	if(arg == NULL || !__ydb_parse_addr(db, arg, &addr) || addr < 0 || addr >= db->yvm->code_size) {
+		printf("(ydb) invalid address `%s`\n", arg != NULL ? arg : "");
+		return;
+	}
+	if(__ydb_break_at(db, addr) != NULL) {
+		return;
+	}
+	for(int i = 0;i < YDB_MAX_POINTS;++i) {
+		if(!db->breaks[i].used) {
+			Instr* code = yvm_private_code(db->yvm);
+			db->breaks[i] = (YdbBreak){ .addr = addr, .saved = code[addr], .used = true };
+			code[addr].type = INSTR_TRAP;
+			printf("(ydb) breakpoint %d at %d\n", i, addr);
+			return;
+		}
+	}
+	printf("(ydb) too many breakpoints\n");
+}
+
+void __ydb_add_watch(Ydb* db, char* kind, char* a, char* b) {
+	int slot = -1;
+	for(int i = 0;i < YDB_MAX_POINTS;++i) {
+		if(!db->watches[i].used) {
+			slot = i;
+			break;
+		}
+	}
+	if(slot == -1 || kind == NULL) {
+		printf("(ydb) cannot add watchpoint\n");
+		return;
+	}
+	YdbWatch* w = &db->watches[slot];
+	memset(w, 0, sizeof(YdbWatch));
+	if(strcmp(kind, "mem") == 0) {
+		int addr = a != NULL ? atoi(a) : -1;
+		int len = b != NULL ? atoi(b) : 4;
+		if(addr < 0 || len <= 0 || addr + len > YVM_MEM_CAPACITY) {
+			printf("(ydb) invalid memory range\n");
+			return;
+		}
+		w->kind = YDB_WATCH_MEM;
+		w->addr = addr;
+		w->len = len;
+		w->snapshot = malloc(len);
+		memcpy(w->snapshot, &db->yvm->memory[addr], len);
+	}
+	else if(strcmp(kind, "v0") == 0 || strcmp(kind, "v1") == 0) {
+		w->kind = YDB_WATCH_REG;
+		w->reg = strcmp(kind, "v0") == 0 ? REG_V0 : REG_V1;
+		w->has_value = a != NULL;
+		w->value = a != NULL ? atoi(a) : 0;
+		w->last = *__find_reg(db->yvm, w->reg);
+	}
+	else {
+		printf("(ydb) unknown watch kind `%s`\n", kind);
+		return;
+	}
+	w->used = true;
+	db->watch_count += 1;
+	printf("(ydb) watchpoint %d\n", YDB_MAX_POINTS + slot);
+}
+
+void __ydb_remove(Ydb* db, int n) {
+	if(n < YDB_MAX_POINTS && db->breaks[n].used) {
+		yvm_private_code(db->yvm)[db->breaks[n].addr] = db->breaks[n].saved;
+		db->breaks[n].used = false;
+	}
+	n -= YDB_MAX_POINTS;
+	if(n >= 0 && db->watches[n].used) {
+		free(db->watches[n].snapshot);
+		db->watches[n].used = false;
+		db->watch_count -= 1;
+	}
+}
+
+void __ydb_delete(Ydb* db, const char* arg) {
+	int n = arg != NULL ? atoi(arg) : -1;
+	if(n < 0 || n >= 2 * YDB_MAX_POINTS) {
+		printf("(ydb) invalid number\n");
+		return;
+	}
+	__ydb_remove(db, n);
+}
+
+void __ydb_info(Ydb* db) {
+	for(int i = 0;i < YDB_MAX_POINTS;++i) {
+		if(db->breaks[i].used) {
+			printf("    break %d at %d\n", i, db->breaks[i].addr);
+		}
+		if(db->watches[i].used) {
+			YdbWatch* w = &db->watches[i];
+			int id = YDB_MAX_POINTS + i;
+			if(w->kind == YDB_WATCH_MEM) printf("    watch %d memory[%d, %d)\n", id, w->addr, w->addr + w->len);
+			else if(w->has_value) printf("    watch %d %s == %d\n", id, __reg_no_to_cstr(w->reg), w->value);
+			else printf("    watch %d %s\n", id, __reg_no_to_cstr(w->reg));
+		}
+	}
+}
+
+void __ydb_examine(Ydb* db, const char* a, const char* b) {
+	int addr = a != NULL ? atoi(a) : db->yvm->stack_base;
+	int n = b != NULL ? atoi(b) : 1;
+	for(int i = 0;i < n && addr >= 0 && addr + 4 <= YVM_MEM_CAPACITY;++i, addr += 4) {
+		int value;
+		memcpy(&value, &db->yvm->memory[addr], 4);
+		printf("    [%d] %d\n", addr, value);
+	}
+}
+
+// runs the program under the debugger, returns false if it stopped on
+// an error or was quit
+bool ydb_run(YulaVM* yvm, const char* script_path) {
+	Ydb db;
+	memset(&db, 0, sizeof(Ydb));
+	db.yvm = yvm;
+	if(script_path != NULL) {
+		db.script = fopen(script_path, "r");
+		if(db.script == NULL) {
+			fprintf(stderr, "ERROR: cannot open script `%s`\n", script_path);
+			return false;
+		}
+	}
+	puts("(ydb) type `help` for commands");
+	__ydb_show(&db);
+	bool ok = true;
+	char line[256];
+	while(yvm->ip < yvm->code_size) {
+		fputs("(ydb) ", stdout);
+		fflush(stdout);
+		if(!__ydb_read_line(&db, line, sizeof(line))) {
+			// no more input, let the program finish
+			strcpy(line, "continue");
+			putchar('\n');
+		}
+		char* cmd = strtok(line, " \t\r\n");
+		char* a = strtok(NULL, " \t\r\n");
+		char* b = strtok(NULL, " \t\r\n");
+		char* c = strtok(NULL, " \t\r\n");
+		if(cmd == NULL || cmd[0] == '#') {
+			continue;
+		}
+		Err e = ERR_OK;
+		if(strcmp(cmd, "break") == 0 || strcmp(cmd, "b") == 0) {
+			__ydb_add_break(&db, a);
+		}
+		else if(strcmp(cmd, "delete") == 0) {
+			__ydb_delete(&db, a);
+		}
+		else if(strcmp(cmd, "watch") == 0) {
+			__ydb_add_watch(&db, a, b, c);
+		}
+		else if(strcmp(cmd, "continue") == 0 || strcmp(cmd, "c") == 0) {
+			e = __ydb_continue(&db);
+			if(e == ERR_TRAP) {
+				printf("(ydb) breakpoint at %d\n", yvm->ip);
+				e = ERR_OK;
+			}
+			__ydb_show(&db);
+		}
+		else if(strcmp(cmd, "step") == 0 || strcmp(cmd, "s") == 0) {
+			int n = a != NULL ? atoi(a) : 1;
+			for(int i = 0;i < n && e == ERR_OK && yvm->ip < yvm->code_size;++i) {
+				e = __ydb_step(&db);
+				if(db.watch_count > 0 && __ydb_check_watches(&db)) {
+					break;
+				}
+			}
+			__ydb_show(&db);
+		}
+		else if(strcmp(cmd, "regs") == 0) {
+			printf("    v0: %d, v1: %d, ip: %d, bp: %d, sp: %d\n", yvm->v0, yvm->v1, yvm->ip, yvm->stack_base, yvm->stack_head);
+		}
+		else if(strcmp(cmd, "x") == 0) {
+			__ydb_examine(&db, a, b);
+		}
+		else if(strcmp(cmd, "info") == 0) {
+			__ydb_info(&db);
+		}
+		else if(strcmp(cmd, "quit") == 0 || strcmp(cmd, "q") == 0) {
+			ok = false;
+			break;
+		}
+		else {
+			puts("    break <addr|label>, delete <n>, watch mem <addr> <len>, watch v0|v1 [value],");
+			puts("    continue, step [n], regs, x <addr> [n], info, quit");
+		}
+		if(e != ERR_OK) {
+			printf("(ydb) SIGNAL: %s at %d\n", err_as_cstr(e), yvm->ip);
+			ok = false;
+			break;
+		}
+	}
+	if(ok) {
+		printf("(ydb) program exited with code %d\n", yvm->exit_code);
+	}
+	for(int i = 0;i < 2 * YDB_MAX_POINTS;++i) {
+		__ydb_remove(&db, i);
+	}
+	if(db.script != NULL) {
+		fclose(db.script);
+	}
+	return ok;
+}
+
+#endif // __YDB_H__
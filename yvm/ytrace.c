@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "yvm.h"
+#include "binfiles.h"
+#include "trace.h"
+
+// replays a trace written by `yvm --trace` against the program it was
+// recorded from and prints the VM state at a step
+
+void usage(FILE* stream) {
+	fputs("Incorrect usage... Correct is:\n", stream);
+	fputs("ytrace <input.bin> <trace.ytr> [flags]\n", stream);
+	fputs("    --at <step>  state after `step` instructions (default: the last one)\n", stream);
+	fputs("    --events     list the recorded jumps and syscalls\n", stream);
+}
+
+void print_addr(YulaVM* yvm, int addr) {
+	printf("%d", addr);
+	int offset = 0;
+	const char* label = yvm_debug_label_at(yvm->debug_info, addr, &offset);
+	if(label != NULL) {
+		printf(" <%s+%d>", label, offset);
+	}
+}
+
+// the events only need the keyframe ip, runs are straight line code
+void print_events(YulaVM* yvm, const YvmTrace* tr) {
+	printf("events {\n");
+	for(int c = 0;c < (int)tr->opened;++c) {
+		const YvmTraceChunk* chunk = &tr->chunks[c];
+		YulaVM state = *yvm;
+		state.memory = calloc(YVM_MEM_CAPACITY, 1);
+		if(!__trace_decode_keyframe(&state, chunk->keyframe, chunk->keyframe_size)) {
+			fputs("ERROR: corrupted trace\n", stderr);
+			exit(1);
+		}
+		free(state.memory);
+		int ip = state.ip;
+		uint64_t step = chunk->first_step;
+		uint32_t pos = 0;
+		while(pos < chunk->size) {
+			YvmTraceEvent ev;
+			if(!__trace_read_event(chunk, &pos, &ev)) {
+				fputs("ERROR: corrupted trace\n", stderr);
+				exit(1);
+			}
+			step += ev.run;
+			int from = ip + (int)ev.run - 1;
+			if(ev.kind == YVM_TRACE_END) {
+				printf("    %10llu  end at ", (unsigned long long)step);
+				print_addr(yvm, from + 1);
+				putchar('\n');
+				break;
+			}
+			ip = from + 1 + ev.delta;
+			printf("    %10llu  ", (unsigned long long)step);
+			print_addr(yvm, from);
+			printf(" -> ");
+			print_addr(yvm, ip);
+			if(ev.kind == YVM_TRACE_SYSCALL) {
+				printf("  syscall v0: %d, v1: %d, sp: %d", ev.v0, ev.v1, ev.sp);
+			}
+			putchar('\n');
+		}
+	}
+	printf("}\n");
+}
+
+int main(int argc, const char* argv[]) {
+
+	if(argc < 3) {
+		usage(stderr);
+		exit(1);
+	}
+
+	YulaVM* _Yvm = malloc(sizeof(YulaVM));
+	init_yvm(_Yvm, YVM_MEM_CAPACITY);
+
+	uint8_t header[YVM_HEADER_SIZE];
+	if(!read_bin_header(argv[1], (char*)header)) {
+		fprintf(stderr, "ERROR: cannot read `%s`\n", argv[1]);
+		exit(1);
+	}
+	FILE_SIZE = get_file_size_wp(argv[1]);
+	size_t code_count = yvm_code_count(header, FILE_SIZE);
+	if(code_count > YVM_CODE_CAPACITY) {
+		fprintf(stderr, "ERROR: program too large (%zu instructions, max %d)\n", code_count, YVM_CODE_CAPACITY);
+		exit(1);
+	}
+	if(YVM_HEADER_SIZE + code_count * sizeof(Instr) > (size_t)FILE_SIZE) {
+		fputs("ERROR: corrupted yvm bytecode\n", stderr);
+		exit(1);
+	}
+	Instr* buffer = (Instr*)malloc(code_count * sizeof(Instr) + 1);
+	if(!read_bin_file_n(argv[1], (char*)buffer, code_count * sizeof(Instr))) {
+		fprintf(stderr, "ERROR: cannot read `%s`\n", argv[1]);
+		exit(1);
+	}
+	yvm_load_bytecode(_Yvm, buffer, code_count, tmp_buf);
+	_Yvm->debug_info = yvm_load_debug_info(argv[1]);
+
+	YvmTrace* trace = malloc(sizeof(YvmTrace));
+	if(!yvm_trace_read(trace, argv[2])) {
+		fprintf(stderr, "ERROR: `%s` is not a yvm trace\n", argv[2]);
+		exit(1);
+	}
+	if(trace->opened == 0) {
+		fputs("ERROR: empty trace\n", stderr);
+		exit(1);
+	}
+
+	uint64_t step = trace->steps;
+	bool events = false;
+	for(int i = 3;i < argc;++i) {
+		if(strcmp(argv[i], "--at") == 0 && i + 1 < argc) {
+			step = strtoull(argv[++i], NULL, 10);
+		}
+		else if(strcmp(argv[i], "--events") == 0) {
+			events = true;
+		}
+	}
+
+	uint64_t first = trace->chunks[0].first_step;
+	printf("trace(YVM) {\n");
+	printf("    status: %s,\n", err_as_cstr(trace->status));
+	printf("    exit_code: %d,\n", trace->exit_code);
+	printf("    steps: %llu,\n", (unsigned long long)trace->steps);
+	printf("    retained: %llu..%llu\n", (unsigned long long)first, (unsigned long long)trace->steps);
+	printf("}\n");
+	if(events) {
+		print_events(_Yvm, trace);
+	}
+	if(step < first || step > trace->steps) {
+		fprintf(stderr, "ERROR: step %llu is outside the retained history\n", (unsigned long long)step);
+		exit(1);
+	}
+
+	int chunk = yvm_trace_chunk_for(trace, step);
+	YvmReplayStatus status = yvm_trace_replay(_Yvm, trace, chunk, step);
+	if(status != YVM_REPLAY_OK) {
+		fprintf(stderr, "ERROR: %s\n", status == YVM_REPLAY_CORRUPT ? "corrupted trace" : "trace does not match the program");
+		exit(1);
+	}
+	// memory writes are the words that differ from the keyframe
+	uint8_t* before = calloc(YVM_MEM_CAPACITY, 1);
+	YulaVM keyframe = *_Yvm;
+	keyframe.memory = before;
+	__trace_decode_keyframe(&keyframe, trace->chunks[chunk].keyframe, trace->chunks[chunk].keyframe_size);
+
+	printf("replay(YVM) {\n");
+	printf("    step: %llu,\n", (unsigned long long)step);
+	printf("    ip: ");
+	print_addr(_Yvm, _Yvm->ip);
+	if(_Yvm->ip >= 0 && _Yvm->ip < _Yvm->code_size) {
+		printf(" (%s %d)", inst_as_cstr(_Yvm->code[_Yvm->ip].type), _Yvm->code[_Yvm->ip].operand);
+	}
+	printf(",\n");
+	printf("    bp: %d,\n", _Yvm->stack_base);
+	printf("    sp: %d,\n", _Yvm->stack_head);
+	printf("    registers {\n");
+	printf("        v0: %d,\n", _Yvm->v0);
+	printf("        v1: %d\n", _Yvm->v1);
+	printf("    }\n");
+	printf("    stack {\n");
+	for(int addr = _Yvm->stack_head - 4;addr >= _Yvm->stack_base && addr >= 0;addr -= 4) {
+		int value;
+		memcpy(&value, &_Yvm->memory[addr], 4);
+		printf("        [%d] %d\n", addr, value);
+	}
+	printf("    }\n");
+	printf("    writes since %llu {\n", (unsigned long long)trace->chunks[chunk].first_step);
+	for(int addr = 0;addr + 4 <= YVM_MEM_CAPACITY;addr += 4) {
+		if(memcmp(&before[addr], &_Yvm->memory[addr], 4) != 0) {
+			int old_value;
+			int new_value;
+			memcpy(&old_value, &before[addr], 4);
+			memcpy(&new_value, &_Yvm->memory[addr], 4);
+			printf("        [%d] %d -> %d\n", addr, old_value, new_value);
+		}
+	}
+	printf("    }\n");
+	printf("}\n");
+
+	free(before);
+	destroy_yvm_trace(trace);
+	free(trace);
+	yvm_free_debug_info(_Yvm->debug_info);
+	yvm_detach_program(_Yvm);
+	free(_Yvm->memory);
+	free(_Yvm);
+	free(buffer);
+
+	return 0;
+}
@@ -8,6 +8,11 @@
 #include <string.h>
 #include <stdbool.h>
 #include "arena.h"
+#include "debuginfo.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 typedef enum {
 	INSTR_PUSH = 0,
@@ -25,6 +30,16 @@ typedef enum {
 	INSTR_PUSH_BP = 12,
 	INSTR_PUSH_SP = 13,
 	INSTR_JMP_ONSTACK = 14,
+	INSTR_TRAP = 15, // breakpoint patched in by ydb, never emitted by yasm
+	INSTR_LOAD = 16,
+	INSTR_STORE = 17,
+	INSTR_MEMCPY = 18,
+	INSTR_MEMSET = 19,
+	INSTR_MEMCMP = 20,
+	INSTR_VADD = 21,
+	INSTR_VMUL = 22,
+	INSTR_VSUM = 23,
+	INSTR_JTAB = 24,
 } InstrType;
 
 typedef struct Instr {
@@ -36,15 +51,83 @@ typedef struct Instr {
 #define YVM_MEM_CAPACITY 64000
 #define YVM_DEF_STACK_LOC 21000
 
+typedef enum Err {
+	ERR_OK,
+	ERR_STACK_UNDERFLOW,
+	ERR_STACK_OVERFLOW,
+	ERR_ILLEGAL_INST,
+	ERR_ILLEGAL_SYSCALL_NO,
+	ERR_TRAP,
+	ERR_SNAPSHOT,
+	ERR_OUT_OF_FUEL,
+	ERR_DEADLINE,
+	ERR_IO_PARKED,
+	ERR_BAD_ACCESS,
+	ERR_MAPPED_STATE, // snapshots and traces do not carry mapped files
+} Err;
+
+#define YVM_SYSCALL_CAPACITY 64
+
+struct YulaVM;
+
+// a native service behind a syscall number. arguments are read in place
+// with yvm_arg and results go back through v1 or yvm_push
+typedef Err (*YvmHostFn)(struct YulaVM* yvm, void* ctx);
+
+// dense table indexed by v0, a syscall is one bounds check and one
+// indirect call. tables can be shared by any number of VMs
+typedef struct YvmHostTable {
+	YvmHostFn fns[YVM_SYSCALL_CAPACITY];
+	void* ctx[YVM_SYSCALL_CAPACITY];
+	const char* names[YVM_SYSCALL_CAPACITY];
+} YvmHostTable;
+
+#define YVM_MAX_MAPPINGS 16
+// host files are mapped above the flat memory, see filemap.h
+#define YVM_MAP_BASE 0x01000000
+
+typedef struct YvmMapping {
+	int addr; // VM address of the first byte
+	int len;
+	bool writable; // copy-on-write, read-only otherwise
+	uint8_t* data;
+} YvmMapping;
+
+// a form of the code derived once per program, like the register form
+// in regir.h, freed with the program
+typedef struct YvmDecoded {
+	void (*destroy)(struct YvmDecoded* decoded);
+} YvmDecoded;
+
+// the code of a program, immutable once built and shared by every VM
+// running it, so a VM only carries its registers and memory. programs
+// are reference counted and freed with the last VM or host holding one
+typedef struct YvmProgram {
+	int refs;
+	int code_size;
+	YvmDecoded* decoded; // NULL until first needed
+	uint8_t* data; // initial contents of memory[data_addr, data_addr+data_size)
+	int data_addr;
+	int data_size;
+	Instr code[];
+} YvmProgram;
+
 typedef struct YulaVM {
 	uint8_t* memory;
 	int stack_base;
 	int stack_head;
 	int v0;
 	int v1;
-	Instr code[YVM_CODE_CAPACITY];
-	int code_size;
+	YvmProgram* program;
+	const Instr* code; // program->code
+	int code_size; // program->code_size, the end of the run
 	int ip;
+	int exit_code;
+	YvmDebugInfo* debug_info; // NULL unless debugging or profiling
+	bool snapshot_armed; // the snapshot syscall stops the run, see snapshot.h
+	YvmHostTable* host; // the builtin services unless the host installs its own
+	YvmMapping maps[YVM_MAX_MAPPINGS];
+	int map_count;
 } YulaVM;
 
 void dump_yvm_state(YulaVM* yvm, FILE* stream) {
@@ -61,29 +144,202 @@ void dump_yvm_state(YulaVM* yvm, FILE* stream) {
 	fprintf(stream, "}\n");
 }
 
+typedef enum __sycall_no_ {
+	__syscall_dump_state = 0,
+	__syscall_dump_v1 = 1,
+	__syscall_exit = 2,
+	__syscall_snapshot = 3,
+} __sycall_no_;
+
+Err __host_dump_state(YulaVM* yvm, void* ctx) {
+	(void)ctx;
+	dump_yvm_state(yvm, stdout);
+	return ERR_OK;
+}
+
+Err __host_dump_v1(YulaVM* yvm, void* ctx) {
+	(void)ctx;
+	printf("%d\n", yvm->v1);
+	return ERR_OK;
+}
+
+Err __host_exit(YulaVM* yvm, void* ctx) {
+	(void)ctx;
+	// falling off the end stops every dispatch loop
+	yvm->exit_code = yvm->v1;
+	yvm->ip = yvm->code_size;
+	return ERR_OK;
+}
+
+Err __host_snapshot(YulaVM* yvm, void* ctx) {
+	(void)ctx;
+	// v1 receives the request input, 0 when nobody is serving requests
+	yvm->v1 = 0;
+	if(yvm->snapshot_armed && yvm->map_count > 0) {
+		return ERR_MAPPED_STATE;
+	}
+	return yvm->snapshot_armed ? ERR_SNAPSHOT : ERR_OK;
+}
+
+// installs `fn` as syscall `no`, replacing what was there
+bool yvm_host_register(YvmHostTable* table, int no, const char* name, YvmHostFn fn, void* ctx) {
+	if(no < 0 || no >= YVM_SYSCALL_CAPACITY) {
+		return false;
+	}
+	table->fns[no] = fn;
+	table->ctx[no] = ctx;
+	table->names[no] = name;
+	return true;
+}
+
+// the builtin services, initialized statically so any number of
+// threads can create VMs at once
+static YvmHostTable __yvm_builtin_table = {
+	.fns = {
+		[__syscall_dump_state] = __host_dump_state,
+		[__syscall_dump_v1] = __host_dump_v1,
+		[__syscall_exit] = __host_exit,
+		[__syscall_snapshot] = __host_snapshot,
+	},
+	.names = {
+		[__syscall_dump_state] = "dump_state",
+		[__syscall_dump_v1] = "dump_v1",
+		[__syscall_exit] = "exit",
+		[__syscall_snapshot] = "snapshot",
+	},
+};
+
+// a table holding only the builtin services, hosts add theirs on top
+void yvm_host_init(YvmHostTable* table) {
+	*table = __yvm_builtin_table;
+}
+
+YvmHostTable* __yvm_builtin_host(void) {
+	return &__yvm_builtin_table;
+}
+
 void init_yvm(YulaVM* yvm, int memory_size) {
-	yvm->memory = malloc(memory_size);
+	// zeroed so runs are reproducible, trace keyframes rely on it to stay small
+	yvm->memory = calloc(memory_size, 1);
 	yvm->ip = 0;
 	yvm->stack_base = YVM_DEF_STACK_LOC;
 	yvm->stack_head = YVM_DEF_STACK_LOC;
 	yvm->v0 = 0;
 	yvm->v1 = 0;
+	yvm->exit_code = 0;
+	yvm->debug_info = NULL;
+	yvm->snapshot_armed = false;
+	yvm->host = __yvm_builtin_host();
+	yvm->map_count = 0;
+	yvm->program = NULL;
+	yvm->code = NULL;
+	yvm->code_size = 0;
+}
+
+YvmProgram* yvm_program_new(const Instr* code, size_t count) {
+	YvmProgram* prog = malloc(sizeof(YvmProgram) + count * sizeof(Instr));
+	prog->refs = 1;
+	prog->code_size = (int)count;
+	prog->decoded = NULL;
+	prog->data = NULL;
+	prog->data_addr = 0;
+	prog->data_size = 0;
+	memcpy(prog->code, code, count * sizeof(Instr));
+	return prog;
+}
+
+// the data section of `prog`, copied into memory when a VM attaches it
+void yvm_program_data(YvmProgram* prog, int addr, const uint8_t* data, int size) {
+	free(prog->data);
+	prog->data = size > 0 ? malloc(size) : NULL;
+	prog->data_addr = addr;
+	prog->data_size = size;
+	if(size > 0) {
+		memcpy(prog->data, data, size);
+	}
+}
+
+YvmProgram* yvm_program_retain(YvmProgram* prog) {
+	__atomic_add_fetch(&prog->refs, 1, __ATOMIC_RELAXED);
+	return prog;
+}
+
+void yvm_program_release(YvmProgram* prog) {
+	if(prog == NULL || __atomic_sub_fetch(&prog->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+		return;
+	}
+	if(prog->decoded != NULL) {
+		prog->decoded->destroy(prog->decoded);
+	}
+	free(prog->data);
+	free(prog);
+}
+
+// copies the data section of the program into memory
+void yvm_init_data(YulaVM* yvm) {
+	const YvmProgram* prog = yvm->program;
+	if(prog->data_size > 0) {
+		memcpy(yvm->memory + prog->data_addr, prog->data, prog->data_size);
+	}
+}
+
+// the VM runs `prog` and holds a reference to it, its memory starts
+// with the data of `prog`
+void yvm_attach_program(YulaVM* yvm, YvmProgram* prog) {
+	YvmProgram* old = yvm->program;
+	yvm->program = yvm_program_retain(prog);
+	yvm->code = prog->code;
+	yvm->code_size = prog->code_size;
+	yvm_program_release(old);
+	yvm_init_data(yvm);
+}
+
+void yvm_detach_program(YulaVM* yvm) {
+	yvm_program_release(yvm->program);
+	yvm->program = NULL;
+	yvm->code = NULL;
+	yvm->code_size = 0;
+}
+
+// code only this VM runs, for patching it. shared programs are copied
+Instr* yvm_private_code(YulaVM* yvm) {
+	YvmProgram* prog = yvm->program;
+	if(__atomic_load_n(&prog->refs, __ATOMIC_ACQUIRE) > 1 || prog->decoded != NULL) {
+		// swapped in place, attaching would reset the data of a running program
+		YvmProgram* copy = yvm_program_new(prog->code, prog->code_size);
+		yvm_program_data(copy, prog->data_addr, prog->data, prog->data_size);
+		yvm->program = copy;
+		yvm->code = copy->code;
+		yvm_program_release(prog);
+		prog = copy;
+	}
+	return prog->code;
+}
+
+void yvm_release_mapping(YvmMapping* m) {
+#ifndef _WIN32
+	munmap(m->data, m->len);
+#else
+	free(m->data);
+#endif
+}
+
+// unmaps every file the program mapped, part of tearing the VM down
+void yvm_release_mappings(YulaVM* yvm) {
+	for(int i = 0;i < yvm->map_count;++i) {
+		yvm_release_mapping(&yvm->maps[i]);
+	}
+	yvm->map_count = 0;
 }
 
 void err_destroy_yvm(YulaVM* yvm) {
+	yvm_release_mappings(yvm);
+	yvm_detach_program(yvm);
 	free(yvm->memory);
 	free(yvm);
 	exit(1);
 }
 
-typedef enum Err {
-	ERR_OK,
-	ERR_STACK_UNDERFLOW,
-	ERR_STACK_OVERFLOW,
-	ERR_ILLEGAL_INST,
-	ERR_ILLEGAL_SYSCALL_NO,
-} Err;
-
 const char* err_as_cstr(Err e) {
 	switch(e) {
 	case ERR_OK:
@@ -96,6 +352,20 @@ const char* err_as_cstr(Err e) {
 		return "illegal instruction";
 	case ERR_ILLEGAL_SYSCALL_NO:
 		return "illegal syscall";
+	case ERR_TRAP:
+		return "breakpoint trap";
+	case ERR_SNAPSHOT:
+		return "snapshot point";
+	case ERR_OUT_OF_FUEL:
+		return "out of fuel";
+	case ERR_DEADLINE:
+		return "deadline exceeded";
+	case ERR_IO_PARKED:
+		return "parked on io";
+	case ERR_BAD_ACCESS:
+		return "bad memory access";
+	case ERR_MAPPED_STATE:
+		return "state with mapped files cannot be saved";
 	default:
 		fputs("error unreacheable at err_as_cstr(...)\n", stderr);
 		exit(1);
@@ -115,28 +385,12 @@ int* __find_reg(YulaVM* yvm, int reg) {
 	return &(yvm->v0);
 }
 
-typedef enum __sycall_no_ {
-	__syscall_dump_state = 0,
-	__syscall_dump_v1 = 1,
-	__syscall_exit = 2,
-} __sycall_no_;
-
-Err __invoke_syscall(YulaVM* yvm) {
-	int __syscall_no = yvm->v0;
-	if(__syscall_no == __syscall_dump_state) {
-		dump_yvm_state(yvm, stdout);
-		return ERR_OK;
-	}
-	if(__syscall_no == __syscall_dump_v1) {
-		printf("%d\n", yvm->v1);
-		return ERR_OK;
+static inline Err __invoke_syscall(YulaVM* yvm) {
+	unsigned int no = (unsigned int)yvm->v0;
+	if(no >= YVM_SYSCALL_CAPACITY || yvm->host->fns[no] == NULL) {
+		return ERR_ILLEGAL_SYSCALL_NO;
 	}
-	if(__syscall_no == __syscall_exit) {
-		free(yvm->memory);
-		free(yvm);
-		exit(yvm->v1);
-	}
-	return ERR_ILLEGAL_SYSCALL_NO;
+	return yvm->host->fns[no](yvm, yvm->host->ctx[no]);
 }
 
 const char* inst_as_cstr(InstrType type) {
@@ -171,6 +425,26 @@ const char* inst_as_cstr(InstrType type) {
 		return "spush";
 	case INSTR_JMP_ONSTACK:
 		return "sjmp";
+	case INSTR_TRAP:
+		return "trap";
+	case INSTR_LOAD:
+		return "load";
+	case INSTR_STORE:
+		return "store";
+	case INSTR_MEMCPY:
+		return "memcpy";
+	case INSTR_MEMSET:
+		return "memset";
+	case INSTR_MEMCMP:
+		return "memcmp";
+	case INSTR_VADD:
+		return "vadd";
+	case INSTR_VMUL:
+		return "vmul";
+	case INSTR_VSUM:
+		return "vsum";
+	case INSTR_JTAB:
+		return "jtab";
 	default:
 		return "UNKOWN";
 	}
@@ -210,6 +484,41 @@ Err yvm_pop(YulaVM* yvm, int* to) {
 	return ERR_OK;
 }
 
+// host pointer to VM memory[addr, addr + len), which is either the flat
+// memory or one mapping. NULL if the range is not addressable, or
+// read-only when `write` is set
+static inline uint8_t* yvm_mem_ptr(YulaVM* yvm, int addr, int len, bool write) {
+	if(addr >= 0 && len >= 0 && addr <= YVM_MEM_CAPACITY - len) {
+		return &yvm->memory[addr];
+	}
+	for(int i = 0;i < yvm->map_count;++i) {
+		YvmMapping* m = &yvm->maps[i];
+		if(addr >= m->addr && len >= 0 && addr - m->addr <= m->len - len) {
+			return (write && !m->writable) ? NULL : m->data + (addr - m->addr);
+		}
+	}
+	return NULL;
+}
+
+// the n-th word from the top of the stack, in place, NULL if the stack
+// holds fewer words. host functions read their arguments through it
+static inline int* yvm_arg(YulaVM* yvm, int n) {
+	int addr = yvm->stack_head - 4 * (n + 1);
+	if(n < 0 || addr < yvm->stack_base) {
+		return NULL;
+	}
+	return (int*)&yvm->memory[addr];
+}
+
+// drops `count` arguments a host function has consumed
+static inline Err yvm_drop(YulaVM* yvm, int count) {
+	if(yvm->stack_head - 4 * count < yvm->stack_base) {
+		return ERR_STACK_UNDERFLOW;
+	}
+	yvm->stack_head -= 4 * count;
+	return ERR_OK;
+}
+
 const char* __reg_no_to_cstr(int reg) {
 	if(reg == REG_V0) {
 		return "v0";
@@ -220,9 +529,9 @@ const char* __reg_no_to_cstr(int reg) {
 	return "v0";
 }
 
-void __process_debug_cstate(YulaVM* yvm) {
-	// printf("(ydb) info [v0: %d, v1: %d, ip: %d]\n", yvm->v0, yvm->v1, yvm->ip);
-	Instr cur_inst = yvm->code[yvm->ip];
+// prints `cur_inst` as the instruction at ip, ydb passes the original
+// instruction when ip sits on a breakpoint
+void __process_debug_cstate(YulaVM* yvm, Instr cur_inst) {
 	if(cur_inst.type == INSTR_RPUSH)        printf("(ydb) rpush %s", __reg_no_to_cstr(cur_inst.operand));
 	else if(cur_inst.type == INSTR_MOV_V0)  printf("(ydb) mov v0, %d", cur_inst.operand);
 	else if(cur_inst.type == INSTR_MOV_V1)  printf("(ydb) mov v1, %d", cur_inst.operand);
@@ -233,20 +542,165 @@ void __process_debug_cstate(YulaVM* yvm) {
 	if(yvm->ip == 0 && cur_inst.type == INSTR_JMP) {
 		fputs(" (jump to entry)", stdout);
 	}
+	if(cur_inst.type == INSTR_JMP) {
+		const char* callee = yvm_debug_callee_at(yvm->debug_info, yvm->ip);
+		if(callee != NULL) printf(" (call %s)", callee);
+	}
 	if(cur_inst.type == INSTR_SYSCALL) {
-		if(yvm->v0 == 0)      printf(" (dump state)");
-		else if(yvm->v0 == 1) printf(" (dump v1)");
-		else if(yvm->v0 == 2) printf(" (exit)");
+		unsigned int no = (unsigned int)yvm->v0;
+		if(no < YVM_SYSCALL_CAPACITY && yvm->host->fns[no] != NULL) {
+			printf(" (%s)", yvm->host->names[no] != NULL ? yvm->host->names[no] : "host");
+		}
 		else printf(" WARNING: unkown syscall_no");
 	}
+	const YvmLine* line = yvm_debug_line_at(yvm->debug_info, yvm->ip);
+	if(line != NULL) {
+		int offset = 0;
+		const char* label = yvm_debug_label_at(yvm->debug_info, yvm->ip, &offset);
+		printf("    ; %s %u:%u", yvm->debug_info->strings[line->file], line->line, line->col);
+		if(label != NULL) printf(" <%s+%d>", label, offset);
+	}
+}
+
+// Bulk memory and vector instructions, operands are on the stack and
+// the last one pushed is popped first:
+//   memcpy [dst src len]     copies len bytes, the ranges may overlap
+//   memset [dst byte len]    fills len bytes with the low byte of byte
+//   memcmp [a b len]         -> -1, 0 or 1
+//   vadd   [dst a b n]       dst[i] = a[i] + b[i] over n ints
+//   vmul   [dst a b n]       dst[i] = a[i] * b[i] over n ints
+//   vsum   [a n]             -> sum of n ints
+// every range lies in the flat memory or one mapping, else ERR_BAD_ACCESS.
+// the vector loops go through gcc vector types, 4 ints per operation,
+// which become SSE2 or NEON instructions where the target has them
+typedef uint32_t __yvm_v4u __attribute__((vector_size(16)));
+
+// pops the `count` operands of a bulk instruction, args[0] is the top
+static inline Err __yvm_pop_args(YulaVM* yvm, int* args, int count) {
+	for(int i = 0;i < count;++i) {
+		if(!yvm_can_pop(yvm)) {
+			return ERR_STACK_UNDERFLOW;
+		}
+		yvm_pop(yvm, &args[i]);
+	}
+	return ERR_OK;
+}
+
+// byte size of n ints, -1 when it does not fit
+static inline int __yvm_vec_bytes(int n) {
+	return n >= 0 && n <= INT32_MAX / 4 ? n * 4 : -1;
+}
+
+// forward element by element unless dst starts inside a source, then
+// whole vectors would read elements already written
+static inline bool __yvm_vec_chunked(const uint8_t* dst, const uint8_t* src, int bytes) {
+	return dst <= src || dst >= src + bytes;
+}
+
+static void __yvm_vec_op(uint8_t* dst, const uint8_t* a, const uint8_t* b, int count, bool mul) {
+	size_t n = (size_t)count;
+	size_t i = 0;
+	if(__yvm_vec_chunked(dst, a, count * 4) && __yvm_vec_chunked(dst, b, count * 4)) {
+		for(;i + 4 <= n;i += 4) {
+			__yvm_v4u x;
+			__yvm_v4u y;
+			memcpy(&x, a + 4 * i, 16);
+			memcpy(&y, b + 4 * i, 16);
+			x = mul ? x * y : x + y;
+			memcpy(dst + 4 * i, &x, 16);
+		}
+	}
+	for(;i < n;++i) {
+		uint32_t x;
+		uint32_t y;
+		memcpy(&x, a + 4 * i, 4);
+		memcpy(&y, b + 4 * i, 4);
+		x = mul ? x * y : x + y;
+		memcpy(dst + 4 * i, &x, 4);
+	}
+}
+
+static int __yvm_vec_sum(const uint8_t* a, int count) {
+	size_t n = (size_t)count;
+	__yvm_v4u acc = { 0, 0, 0, 0 };
+	size_t i = 0;
+	for(;i + 4 <= n;i += 4) {
+		__yvm_v4u x;
+		memcpy(&x, a + 4 * i, 16);
+		acc += x;
+	}
+	uint32_t sum = acc[0] + acc[1] + acc[2] + acc[3];
+	for(;i < n;++i) {
+		uint32_t x;
+		memcpy(&x, a + 4 * i, 4);
+		sum += x;
+	}
+	return (int)sum;
 }
 
-Err yvm_exec_instr(YulaVM* yvm, bool debug) {
-	Instr cur_inst = yvm->code[yvm->ip];
-	if(debug) {
-		__process_debug_cstate(yvm);
-		getc(stdin);
+static inline Err __yvm_bulk(YulaVM* yvm, InstrType type) {
+	int args[4];
+	Err e;
+	switch(type) {
+	case INSTR_MEMCPY:
+	case INSTR_MEMSET:
+	case INSTR_MEMCMP:
+	{
+		if((e = __yvm_pop_args(yvm, args, 3)) != ERR_OK) {
+			return e;
+		}
+		int len = args[0];
+		bool write = type != INSTR_MEMCMP;
+		uint8_t* dst = yvm_mem_ptr(yvm, args[2], len, write);
+		const uint8_t* src = type == INSTR_MEMSET ? dst : yvm_mem_ptr(yvm, args[1], len, false);
+		if(dst == NULL || src == NULL) {
+			return ERR_BAD_ACCESS;
+		}
+		yvm->ip += 1;
+		if(type == INSTR_MEMCPY) {
+			memmove(dst, src, len);
+		} else if(type == INSTR_MEMSET) {
+			memset(dst, args[1] & 0xff, len);
+		} else {
+			int r = memcmp(dst, src, len);
+			return yvm_push(yvm, (r > 0) - (r < 0));
+		}
+		return ERR_OK;
 	}
+	case INSTR_VADD:
+	case INSTR_VMUL:
+	{
+		if((e = __yvm_pop_args(yvm, args, 4)) != ERR_OK) {
+			return e;
+		}
+		int bytes = __yvm_vec_bytes(args[0]);
+		uint8_t* dst = yvm_mem_ptr(yvm, args[3], bytes, true);
+		const uint8_t* a = yvm_mem_ptr(yvm, args[2], bytes, false);
+		const uint8_t* b = yvm_mem_ptr(yvm, args[1], bytes, false);
+		if(dst == NULL || a == NULL || b == NULL) {
+			return ERR_BAD_ACCESS;
+		}
+		__yvm_vec_op(dst, a, b, args[0], type == INSTR_VMUL);
+		yvm->ip += 1;
+		return ERR_OK;
+	}
+	default:
+	{
+		if((e = __yvm_pop_args(yvm, args, 2)) != ERR_OK) {
+			return e;
+		}
+		const uint8_t* a = yvm_mem_ptr(yvm, args[1], __yvm_vec_bytes(args[0]), false);
+		if(a == NULL) {
+			return ERR_BAD_ACCESS;
+		}
+		yvm->ip += 1;
+		return yvm_push(yvm, __yvm_vec_sum(a, args[0]));
+	}
+	}
+}
+
+// executes one instruction, shared by every dispatch loop
+static inline Err __yvm_dispatch(YulaVM* yvm, Instr cur_inst) {
 	switch(cur_inst.type) {
 		case INSTR_PUSH:
 		{
@@ -387,42 +841,182 @@ Err yvm_exec_instr(YulaVM* yvm, bool debug) {
 			yvm->ip += 1;
 			break;
 		}
+		case INSTR_LOAD:
+		{
+			int addr;
+			if(!yvm_can_pop(yvm)) {
+				return ERR_STACK_UNDERFLOW;
+			}
+			yvm_pop(yvm, &addr);
+			const uint8_t* src = yvm_mem_ptr(yvm, addr, 4, false);
+			if(src == NULL) {
+				return ERR_BAD_ACCESS;
+			}
+			int value;
+			memcpy(&value, src, 4);
+			yvm->ip += 1;
+			return yvm_push(yvm, value);
+		}
+		case INSTR_STORE:
+		{
+			int value;
+			int addr;
+			if(!yvm_can_pop(yvm)) {
+				return ERR_STACK_UNDERFLOW;
+			}
+			yvm_pop(yvm, &value);
+			if(!yvm_can_pop(yvm)) {
+				return ERR_STACK_UNDERFLOW;
+			}
+			yvm_pop(yvm, &addr);
+			uint8_t* dst = yvm_mem_ptr(yvm, addr, 4, true);
+			if(dst == NULL) {
+				return ERR_BAD_ACCESS;
+			}
+			memcpy(dst, &value, 4);
+			yvm->ip += 1;
+			break;
+		}
+		case INSTR_MEMCPY:
+		case INSTR_MEMSET:
+		case INSTR_MEMCMP:
+		case INSTR_VADD:
+		case INSTR_VMUL:
+		case INSTR_VSUM:
+			return __yvm_bulk(yvm, cur_inst.type);
+		case INSTR_JTAB:
+		{
+			// operand n, then n + 1 jmp words: the default target and
+			// the targets of indices 0 to n - 1
+			int n = cur_inst.operand;
+			if(n < 0 || n >= yvm->code_size - yvm->ip - 1) {
+				return ERR_ILLEGAL_INST;
+			}
+			int index;
+			if(!yvm_can_pop(yvm)) {
+				return ERR_STACK_UNDERFLOW;
+			}
+			yvm_pop(yvm, &index);
+			int slot = (unsigned)index < (unsigned)n ? index + 1 : 0;
+			yvm->ip = yvm->code[yvm->ip + 1 + slot].operand;
+			break;
+		}
+		case INSTR_TRAP:
+			return ERR_TRAP;
 		default:
 			return ERR_ILLEGAL_INST;
 	}
 	return ERR_OK;
 }
 
-void yvm_exec_prog(YulaVM* yvm, bool debug) {
-	if(debug) {
-		printf("start debuging...\n");
-		printf("for execute next instruction press `enter`");
-		getc(stdin);
-	}
+Err yvm_exec_instr(YulaVM* yvm) {
+	return __yvm_dispatch(yvm, yvm->code[yvm->ip]);
+}
+
+// the plain loop, debugging lives in ydb.h and never slows this down
+void yvm_exec_prog(YulaVM* yvm) {
 	for(;yvm->ip < yvm->code_size;) {
-		Err e = yvm_exec_instr(yvm, debug);
+		Err e = yvm_exec_instr(yvm);
 		if(e != ERR_OK) {
 			fprintf(stderr, "SIGNAL: %s\n", err_as_cstr(e));
 			err_destroy_yvm(yvm);
 		}
 	}
-	if(debug) {
-		printf("(ydb) end");
-		getc(stdin);
+}
+
+void yvm_load_bytecode(YulaVM* yvm, const Instr* buffer, size_t size, const char* magic) {
+	if(magic[0] != 'Y' || magic[1] != 'M') {
+		fputs("ERROR: not yvm bytecode provided\n", stderr);
+		exit(1);
 	}
+	YvmProgram* prog = yvm_program_new(buffer, size);
+	yvm_attach_program(yvm, prog);
+	yvm_program_release(prog);
 }
 
-void yvm_load_bytecode(YulaVM* yvm, Instr* buffer, size_t size, char* magic) {
-	size_t i = 0;
-	Instr* buf = buffer;
-	if(magic[0] != 'Y' && magic[1] != 'M') {
+// number of instructions in a bytecode file of `file_size` bytes
+size_t yvm_code_count(const uint8_t* header, size_t file_size) {
+	uint32_t code_count;
+	memcpy(&code_count, header + 4, 4);
+	if(code_count == 0) {
+		// legacy file, everything after the header is code
+		return (file_size - YVM_HEADER_SIZE) / sizeof(Instr);
+	}
+	return code_count;
+}
+
+// reads a data section into `prog`, returns its size in the file or 0
+// when it is damaged or does not fit in memory
+size_t yvm_parse_data_section(YvmProgram* prog, const uint8_t* section, size_t size) {
+	if(size < YVM_DATA_HEADER || section[0] != 'Y' || section[1] != 'I') {
+		return 0;
+	}
+	uint32_t addr;
+	uint32_t len;
+	memcpy(&addr, section + 2, 4);
+	memcpy(&len, section + 6, 4);
+	if(addr > YVM_MEM_CAPACITY || len > YVM_MEM_CAPACITY - addr || len > size - YVM_DATA_HEADER) {
+		return 0;
+	}
+	yvm_program_data(prog, (int)addr, section + YVM_DATA_HEADER, (int)len);
+	return YVM_DATA_HEADER + len;
+}
+
+// reads only the data section of a bytecode file whose code was read
+// on its own, false when the section is damaged
+bool yvm_read_data_file(YvmProgram* prog, const char* path, const uint8_t* header, size_t code_count) {
+	if((header[2] & YVM_HAS_DATA) == 0) {
+		return true;
+	}
+	FILE* file = fopen(path, "rb");
+	if(file == NULL) {
+		return false;
+	}
+	uint8_t head[YVM_DATA_HEADER];
+	uint32_t len = 0;
+	fseek(file, YVM_HEADER_SIZE + (long)(code_count * sizeof(Instr)), SEEK_SET);
+	bool ok = fread(head, 1, YVM_DATA_HEADER, file) == YVM_DATA_HEADER;
+	if(ok) {
+		memcpy(&len, head + 6, 4);
+		ok = len <= YVM_MEM_CAPACITY;
+	}
+	uint8_t* section = ok ? malloc(YVM_DATA_HEADER + len) : NULL;
+	if(ok) {
+		memcpy(section, head, YVM_DATA_HEADER);
+		ok = fread(section + YVM_DATA_HEADER, 1, len, file) == len
+			&& yvm_parse_data_section(prog, section, YVM_DATA_HEADER + len) != 0;
+	}
+	free(section);
+	fclose(file);
+	return ok;
+}
+
+// loads a whole bytecode image already in memory, the debug section is
+// only parsed when `with_debug` is set
+void yvm_load_image(YulaVM* yvm, const uint8_t* image, size_t size, bool with_debug) {
+	if(size < YVM_HEADER_SIZE) {
 		fputs("ERROR: not yvm bytecode provided\n", stderr);
 		exit(1);
 	}
-	for(;i < size;++i) {
-		yvm->code[i] = buf[i];
+	size_t count = yvm_code_count(image, size);
+	if(YVM_HEADER_SIZE + count * sizeof(Instr) > size || count > YVM_CODE_CAPACITY) {
+		fputs("ERROR: corrupted yvm bytecode\n", stderr);
+		exit(1);
+	}
+	yvm_load_bytecode(yvm, (const Instr*)(image + YVM_HEADER_SIZE), count, (const char*)image);
+	size_t section = YVM_HEADER_SIZE + count * sizeof(Instr);
+	if((image[2] & YVM_HAS_DATA) != 0) {
+		size_t data_size = yvm_parse_data_section(yvm->program, image + section, size - section);
+		if(data_size == 0) {
+			fputs("ERROR: corrupted yvm bytecode\n", stderr);
+			exit(1);
+		}
+		yvm_init_data(yvm);
+		section += data_size;
+	}
+	if(with_debug && (image[2] & YVM_HAS_DEBUG) != 0) {
+		yvm->debug_info = yvm_parse_debug_info(image + section, size - section);
 	}
-	yvm->code_size = (int)i;
 }
 
 #endif // __YVM_H__
\ No newline at end of file
@@ -0,0 +1,331 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include "yvm.h"
+#include "binfiles.h"
+
+// yvm2c: translates a bytecode file into C. every instruction becomes a
+// few lines of straight C, jmp becomes goto and sjmp goes through one
+// switch over the addresses the program can jump back to: those it
+// pushes as literals and the return addresses of ipush. jtab becomes a
+// C switch over its table. the runtime in aot.h provides the syscalls,
+// the translated program is then built with the system C compiler.
+
+#ifndef YVM_AOT_RUNTIME
+#define YVM_AOT_RUNTIME "yvm" // directory holding aot.h, relative to the build
+#endif
+
+#ifdef _WIN32
+#define YVM_AOT_CC "gcc"
+#define YVM_AOT_LIBS ""
+#else
+#define YVM_AOT_CC "cc"
+#define YVM_AOT_LIBS " -pthread"
+#endif
+
+void usage(FILE* stream) {
+	fputs("Incorrect usage... Correct is:\n", stream);
+	fputs("yvm2c <input.bin> [flags]\n", stream);
+	fputs("    -o <out.c>           C output (default: <input>.c)\n", stream);
+	fputs("    --exe <path>         build the C output at -O2 into an executable\n", stream);
+	fputs("    --cc <compiler>      C compiler for --exe (default: $CC or " YVM_AOT_CC ")\n", stream);
+	fputs("    --runtime <dir>      directory of aot.h for --exe (default: " YVM_AOT_RUNTIME ")\n", stream);
+}
+
+// addresses reachable through sjmp or by resuming the run
+bool* find_targets(const Instr* code, int count) {
+	bool* targets = calloc(count + 1, sizeof(bool));
+	targets[0] = true;
+	for(int i = 0;i < count;++i) {
+		int op = code[i].operand;
+		switch(code[i].type) {
+		case INSTR_PUSH:
+		case INSTR_JMP:
+			if(op >= 0 && op < count) targets[op] = true;
+			break;
+		case INSTR_PUSH_IP:
+			targets[i + 1] = true;
+			break;
+		case INSTR_SYSCALL:
+			// a parked syscall is resumed at itself
+			targets[i] = true;
+			targets[i + 1] = true;
+			break;
+		default:
+			break;
+		}
+	}
+	return targets;
+}
+
+const char* reg_local(int reg) {
+	return reg == REG_V1 ? "v1" : "v0";
+}
+
+void emit_binop(FILE* out, int i, const char* expr) {
+	fprintf(out, "\t{ int a, b; YVM_AOT_POP(b, %d); YVM_AOT_POP(a, %d); YVM_AOT_PUT(%s); }\n", i, i, expr);
+}
+
+void emit_instr(FILE* out, const Instr* code, int count, int i) {
+	Instr in = code[i];
+	switch(in.type) {
+	case INSTR_PUSH:
+		fprintf(out, "\tYVM_AOT_PUSH(%d, %d);\n", in.operand, i);
+		break;
+	case INSTR_POP:
+		fprintf(out, "\tYVM_AOT_POP(%s, %d);\n", reg_local(in.operand), i);
+		break;
+	case INSTR_SYSCALL:
+		fprintf(out, "\tYVM_AOT_SYNC();\n");
+		fprintf(out, "\tyvm->ip = %d;\n", i + 1);
+		fprintf(out, "\te = __invoke_syscall(yvm);\n");
+		fprintf(out, "\tYVM_AOT_RELOAD();\n");
+		fprintf(out, "\tip = yvm->ip;\n");
+		fprintf(out, "\tif(e != ERR_OK) goto fail;\n");
+		fprintf(out, "\tif(ip != %d) goto dispatch;\n", i + 1);
+		break;
+	case INSTR_MOV_V0:
+		fprintf(out, "\tv0 = %d;\n", in.operand);
+		break;
+	case INSTR_MOV_V1:
+		fprintf(out, "\tv1 = %d;\n", in.operand);
+		break;
+	case INSTR_JMP:
+		if(in.operand >= 0 && in.operand < count) {
+			fprintf(out, "\tgoto L%d;\n", in.operand);
+		} else {
+			fprintf(out, "\tip = %d;\n\tgoto dispatch;\n", in.operand);
+		}
+		break;
+	case INSTR_ADD:
+		emit_binop(out, i, "yvm_aot_add(a, b)");
+		break;
+	case INSTR_SUB:
+		emit_binop(out, i, "yvm_aot_sub(a, b)");
+		break;
+	case INSTR_MUL:
+		emit_binop(out, i, "yvm_aot_mul(a, b)");
+		break;
+	case INSTR_DIV:
+		emit_binop(out, i, "a / b");
+		break;
+	case INSTR_RPUSH:
+		fprintf(out, "\tYVM_AOT_PUSH(%s, %d);\n", reg_local(in.operand), i);
+		break;
+	case INSTR_PUSH_IP:
+		fprintf(out, "\tYVM_AOT_PUSH(%d, %d);\n", i + 1, i);
+		break;
+	case INSTR_PUSH_BP:
+		fprintf(out, "\tYVM_AOT_PUSH(bp, %d);\n", i);
+		break;
+	case INSTR_PUSH_SP:
+		fprintf(out, "\tYVM_AOT_PUSH(sp, %d);\n", i);
+		break;
+	case INSTR_JMP_ONSTACK:
+		fprintf(out, "\tYVM_AOT_POP(ip, %d);\n\tgoto dispatch;\n", i);
+		break;
+	case INSTR_LOAD:
+		fprintf(out, "\t{ int a; YVM_AOT_POP(a, %d); const uint8_t* src = yvm_aot_src(yvm, mem, a);\n", i);
+		fprintf(out, "\t  if(src == NULL) YVM_AOT_FAIL(ERR_BAD_ACCESS, %d); memcpy(&a, src, 4); YVM_AOT_PUT(a); }\n", i);
+		break;
+	case INSTR_STORE:
+		fprintf(out, "\t{ int a, b; YVM_AOT_POP(b, %d); YVM_AOT_POP(a, %d); uint8_t* dst = yvm_aot_dst(yvm, mem, a);\n", i, i);
+		fprintf(out, "\t  if(dst == NULL) YVM_AOT_FAIL(ERR_BAD_ACCESS, %d); memcpy(dst, &b, 4); }\n", i);
+		break;
+	case INSTR_MEMCPY:
+	case INSTR_MEMSET:
+	case INSTR_MEMCMP:
+	case INSTR_VADD:
+	case INSTR_VMUL:
+	case INSTR_VSUM:
+		// the bulk instructions are already loops in the interpreter
+		fprintf(out, "\tYVM_AOT_SYNC();\n\tyvm->ip = %d;\n\te = yvm_exec_instr(yvm);\n\tYVM_AOT_RELOAD();\n", i);
+		fprintf(out, "\tif(e != ERR_OK) { ip = %d; goto fail; }\n", i);
+		break;
+	case INSTR_JTAB:
+		if(in.operand < 0 || in.operand >= count - i - 1) {
+			fprintf(out, "\tYVM_AOT_FAIL(ERR_ILLEGAL_INST, %d);\n", i);
+			break;
+		}
+		fprintf(out, "\t{ int x; YVM_AOT_POP(x, %d);\n", i);
+		fprintf(out, "\t  switch(x) {\n");
+		for(int k = 0;k <= in.operand;++k) {
+			int target = code[i + 1 + k].operand;
+			if(k == 0) {
+				fprintf(out, "\t  default: ");
+			} else {
+				fprintf(out, "\t  case %d: ", k - 1);
+			}
+			if(target >= 0 && target < count) {
+				fprintf(out, "goto L%d;\n", target);
+			} else {
+				fprintf(out, "ip = %d; goto dispatch;\n", target);
+			}
+		}
+		fprintf(out, "\t  }\n\t}\n");
+		break;
+	case INSTR_TRAP:
+		fprintf(out, "\tYVM_AOT_FAIL(ERR_TRAP, %d);\n", i);
+		break;
+	default:
+		fprintf(out, "\tYVM_AOT_FAIL(ERR_ILLEGAL_INST, %d);\n", i);
+		break;
+	}
+}
+
+void translate(FILE* out, const char* input, const YvmProgram* prog) {
+	const Instr* code = prog->code;
+	int count = prog->code_size;
+	bool* targets = find_targets(code, count);
+	fprintf(out, "// generated by yvm2c from `%s`\n", input);
+	fprintf(out, "#include \"aot.h\"\n\n");
+	fprintf(out, "static const Instr yvm2c_code[%d] = {\n", count > 0 ? count : 1);
+	for(int i = 0;i < count;++i) {
+		fprintf(out, "\t{ %d, %d },\n", code[i].type, code[i].operand);
+	}
+	fprintf(out, "};\n\n");
+	fprintf(out, "static const uint8_t yvm2c_data[%d] = {", prog->data_size > 0 ? prog->data_size : 1);
+	for(int i = 0;i < prog->data_size;++i) {
+		fprintf(out, "%s%d,", i % 16 == 0 ? "\n\t" : " ", prog->data[i]);
+	}
+	fprintf(out, "\n};\n\n");
+
+	fprintf(out, "Err yvm2c_run(YulaVM* yvm) {\n");
+	fprintf(out, "\tuint8_t* mem = yvm->memory;\n");
+	fprintf(out, "\tconst int bp = yvm->stack_base;\n");
+	fprintf(out, "\tint sp = yvm->stack_head;\n");
+	fprintf(out, "\tint v0 = yvm->v0;\n");
+	fprintf(out, "\tint v1 = yvm->v1;\n");
+	fprintf(out, "\tint ip = yvm->ip;\n");
+	fprintf(out, "\tErr e = ERR_OK;\n");
+	fprintf(out, "\tgoto dispatch;\n");
+	for(int i = 0;i < count;++i) {
+		if(targets[i]) {
+			fprintf(out, "L%d:\n", i);
+		}
+		fprintf(out, "\t// %s %d\n", inst_as_cstr(code[i].type), code[i].operand);
+		emit_instr(out, code, count, i);
+	}
+	fprintf(out, "\tip = %d;\n", count);
+	fprintf(out, "dispatch:\n");
+	fprintf(out, "\tswitch(ip) {\n");
+	for(int i = 0;i < count;++i) {
+		if(targets[i]) {
+			fprintf(out, "\tcase %d: goto L%d;\n", i, i);
+		}
+	}
+	fprintf(out, "\tdefault: break;\n");
+	fprintf(out, "\t}\n");
+	fprintf(out, "\tif(ip < 0) YVM_AOT_FAIL(ERR_ILLEGAL_INST, ip);\n");
+	fprintf(out, "\t// the end of the program, or an address only known at run time\n");
+	fprintf(out, "\tYVM_AOT_SYNC();\n");
+	fprintf(out, "\tyvm->ip = ip;\n");
+	fprintf(out, "\treturn yvm_aot_interpret(yvm);\n");
+	fprintf(out, "fail:\n");
+	fprintf(out, "\tYVM_AOT_SYNC();\n");
+	fprintf(out, "\tyvm->ip = ip;\n");
+	fprintf(out, "\treturn e;\n");
+	fprintf(out, "}\n\n");
+
+	fprintf(out, "int main(void) {\n");
+	fprintf(out, "\treturn yvm_aot_main(yvm2c_code, %d, yvm2c_data, %d, %d, yvm2c_run);\n", count, prog->data_addr, prog->data_size);
+	fprintf(out, "}\n");
+	free(targets);
+}
+
+int main(int argc, const char* argv[]) {
+
+	if(argc < 2) {
+		usage(stderr);
+		exit(1);
+	}
+
+	const char* out_path = NULL;
+	const char* exe_path = NULL;
+	const char* cc = getenv("CC") != NULL ? getenv("CC") : YVM_AOT_CC;
+	const char* runtime = YVM_AOT_RUNTIME;
+	for(int i = 2;i < argc;++i) {
+		if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+			out_path = argv[++i];
+		}
+		else if(strcmp(argv[i], "--exe") == 0 && i + 1 < argc) {
+			exe_path = argv[++i];
+		}
+		else if(strcmp(argv[i], "--cc") == 0 && i + 1 < argc) {
+			cc = argv[++i];
+		}
+		else if(strcmp(argv[i], "--runtime") == 0 && i + 1 < argc) {
+			runtime = argv[++i];
+		}
+		else {
+			usage(stderr);
+			exit(1);
+		}
+	}
+
+	uint8_t header[YVM_HEADER_SIZE];
+	if(!read_bin_header(argv[1], (char*)header)) {
+		fprintf(stderr, "ERROR: cannot read `%s`\n", argv[1]);
+		exit(1);
+	}
+	if(header[0] != 'Y' || header[1] != 'M') {
+		fputs("ERROR: not yvm bytecode provided\n", stderr);
+		exit(1);
+	}
+	FILE_SIZE = get_file_size_wp(argv[1]);
+	size_t code_count = yvm_code_count(header, FILE_SIZE);
+	if(code_count > YVM_CODE_CAPACITY) {
+		fprintf(stderr, "ERROR: program too large (%zu instructions, max %d)\n", code_count, YVM_CODE_CAPACITY);
+		exit(1);
+	}
+	if(YVM_HEADER_SIZE + code_count * sizeof(Instr) > (size_t)FILE_SIZE) {
+		fputs("ERROR: corrupted yvm bytecode\n", stderr);
+		exit(1);
+	}
+	Instr* code = (Instr*)malloc(code_count * sizeof(Instr) + 1);
+	if(!read_bin_file_n(argv[1], (char*)code, code_count * sizeof(Instr))) {
+		fprintf(stderr, "ERROR: cannot read `%s`\n", argv[1]);
+		exit(1);
+	}
+	YvmProgram* prog = yvm_program_new(code, code_count);
+	free(code);
+	if(!yvm_read_data_file(prog, argv[1], header, code_count)) {
+		fputs("ERROR: corrupted yvm bytecode\n", stderr);
+		exit(1);
+	}
+
+	char default_out[512];
+	if(out_path == NULL) {
+		snprintf(default_out, sizeof(default_out), "%s", argv[1]);
+		char* dot = strrchr(default_out, '.');
+		if(dot != NULL && strchr(dot, '/') == NULL && strchr(dot, '\\') == NULL) {
+			*dot = '\0';
+		}
+		strncat(default_out, ".c", sizeof(default_out) - strlen(default_out) - 1);
+		out_path = default_out;
+	}
+	FILE* out = fopen(out_path, "w");
+	if(out == NULL) {
+		fprintf(stderr, "ERROR: cannot write `%s`\n", out_path);
+		exit(1);
+	}
+	translate(out, argv[1], prog);
+	bool ok = ferror(out) == 0;
+	if(fclose(out) != 0 || !ok) {
+		fprintf(stderr, "ERROR: cannot write `%s`\n", out_path);
+		exit(1);
+	}
+	yvm_program_release(prog);
+
+	if(exe_path != NULL) {
+		char cmd[2048];
+		snprintf(cmd, sizeof(cmd), "%s -O2 -I\"%s\" \"%s\" -o \"%s\"%s", cc, runtime, out_path, exe_path, YVM_AOT_LIBS);
+		if(system(cmd) != 0) {
+			fprintf(stderr, "ERROR: `%s` failed\n", cmd);
+			exit(1);
+		}
+	}
+	return 0;
+}